@@ -0,0 +1,123 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// define the size of the first block of an arena
+#define DEF_ARENA_BLOCK_SIZE 4096
+
+// define the alignment of arena allocations
+#define ARENA_ALIGN 16
+
+// block of memory owned by an arena
+typedef struct arenaBlock {
+	struct arenaBlock *next; // next block, kept across resets
+	size_t size;			 // usable size of the block
+	size_t used;			 // bytes handed out from the block
+} arenaBlock;
+
+// bump allocator for memory which lives until the next reset
+// resetting only rewinds to the first block, the blocks are reused by the following allocations
+typedef struct arena {
+	arenaBlock *first;	 // first block, or NULL
+	arenaBlock *current; // block allocations come from
+	void *last;			 // most recent allocation, it can grow in place
+} arena;
+
+// initialize an empty arena
+void initArena(arena *pool) {
+	pool->first	  = NULL;
+	pool->current = NULL;
+	pool->last	  = NULL;
+}
+
+// round a size up to the arena alignment
+#define arenaRound(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+// return the memory of a block, which starts right after its aligned header
+#define blockData(block) ((char *)(block) + arenaRound(sizeof(arenaBlock)))
+
+// allocate memory from an arena, returning NULL when out of memory
+void *arenaAlloc(arena *pool, size_t size) {
+	arenaBlock *block = pool->current;
+	arenaBlock *newBlock;
+	size_t blockSize;
+
+	size = arenaRound(size);
+	// move on to the next block until one has room, blocks left over from before the last reset are reused
+	while (block != NULL && block->used + size > block->size) {
+		if (block->next != NULL) {
+			block		= block->next;
+			block->used = 0;
+		} else {
+			break;
+		}
+	}
+	if (block == NULL || block->used + size > block->size) {
+		// append a new block, at least twice the size of the last one
+		blockSize = block != NULL ? block->size * 2 : DEF_ARENA_BLOCK_SIZE;
+		while (blockSize < size) {
+			blockSize *= 2;
+		}
+		newBlock = (arenaBlock *)malloc(arenaRound(sizeof(arenaBlock)) + blockSize);
+		if (newBlock == NULL) {
+			return NULL;
+		}
+		newBlock->next = NULL;
+		newBlock->size = blockSize;
+		newBlock->used = 0;
+		if (block != NULL) {
+			block->next = newBlock;
+		} else {
+			pool->first = newBlock;
+		}
+		block = newBlock;
+	}
+	pool->current = block;
+	pool->last	  = blockData(block) + block->used;
+	block->used += size;
+	return pool->last;
+}
+
+// grow an arena allocation, in place when it is the most recent one and its block has room
+void *arenaRealloc(arena *pool, void *ptr, size_t oldSize, size_t newSize) {
+	arenaBlock *block = pool->current;
+	size_t start;
+	void *grown;
+
+	if (ptr != NULL && ptr == pool->last) {
+		start = (char *)ptr - blockData(block);
+		if (start + newSize <= block->size) {
+			block->used = start + arenaRound(newSize);
+			return ptr;
+		}
+	}
+	if ((grown = arenaAlloc(pool, newSize)) != NULL && ptr != NULL) {
+		memcpy(grown, ptr, oldSize);
+	}
+	return grown;
+}
+
+// release everything allocated from an arena in O(1), keeping its blocks for reuse
+void arenaReset(arena *pool) {
+	pool->current = pool->first;
+	pool->last	  = NULL;
+	if (pool->first != NULL) {
+		pool->first->used = 0;
+	}
+}
+
+// free the blocks of an arena
+void freeArena(arena *pool) {
+	arenaBlock *block = pool->first;
+	arenaBlock *next;
+	while (block != NULL) {
+		next = block->next;
+		free(block);
+		block = next;
+	}
+	initArena(pool);
+}
+
+#endif
@@ -0,0 +1,1107 @@
+// the partition benchmarks need POSIX threads, clocks and mappings, which strict ISO C builds like -std=c99 hide
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "token.h"
+#include "postfix.h"
+#include "bytecode.h"
+#include "eval.h"
+
+// the partition benchmarks go well past 64 KiB, so they need partitions with 32-bit element sizes, which grow when full
+#ifndef WIDE_PARTITION
+#define WIDE_PARTITION
+#endif
+#include "shard.h"
+#include "mvcc.h"
+#ifdef HAVE_MMAP
+#include <sys/wait.h>
+#include "shared.h"
+#endif
+
+// define the number of times the lexer benchmark runs over the corpus
+#define LEXER_ROUNDS 200000
+
+// define the number of tokens each scaling benchmark round goes through
+#define SCALE_TOKENS 2000000
+
+// define the number of times the dispatch benchmark runs each program
+#define DISPATCH_ROUNDS 2000000
+
+// define the default number of evaluations of the soak benchmark, and the number of times it reports the memory use
+#define SOAK_EVALS 10000000
+#define SOAK_REPORTS 10
+
+// define the initial size of the partitions of the partition benchmarks
+#define BENCH_PARTITION_SIZE 4096
+
+// define the size of the variable names of the partition benchmarks
+#define BENCH_NAME_SIZE 12
+
+// define the number of lookups and of deletes the lookup benchmark times for each number of variables
+#define LOOKUP_OPS 2000000
+#define LOOKUP_DELETES 200000
+
+// define the number of operations, the number of variable names and the longest string value of the churn benchmark, and
+// the percentage of the partition the live variables fill on average, half of the names are live at any time
+#define CHURN_OPS 4000000
+#define CHURN_NAMES 1000
+#define CHURN_STRING 40
+#define CHURN_FILL 75
+
+// define the length of the string values of the scaling benchmark and the number of lookups it times
+#define WIDE_STRING 100
+#define WIDE_LOOKUPS 2000000
+
+// define the snapshot file of the startup benchmark and the number of times it times each way of starting
+#define STARTUP_PATH "bench.snapshot"
+#define STARTUP_ROUNDS 5
+
+// define the partition size of the backend benchmark, in MB, the number of scans of the whole partition and of lookups it times
+#define BACKEND_MB 64
+#define BACKEND_SCANS 20
+#define BACKEND_LOOKUPS 2000000
+
+// define the names of the partition allocation backends
+char *backendNames[] = {"malloc", "mmap", "hugepage", "hugetlb"};
+
+// define the number of variables of the reader scaling benchmark, the time each step runs, in ms, the number of lookups a
+// reader makes in each version it acquires and the time the writer waits between two publishes, in µs
+#define READERS_VARS 10000
+#define READERS_MS 500
+#define READERS_LOOKUPS 16
+#define READERS_PAUSE_US 1000
+
+// define the number of variables of the mixed workload benchmark, the time each step runs, in ms, and the largest number
+// of threads it runs
+#define MIXED_VARS 10000
+#define MIXED_MS 500
+#define MIXED_THREADS 32
+
+// define the number of worker processes of the shared partition benchmark, the number of variables they look up and the
+// length of the variable values
+#define WORKERS 8
+#define WORKER_VARS 50000
+#define WORKER_STRING 40
+
+// define the expressions of token.c, which the lexer benchmark runs over
+char *corpus[] = {
+	"234",
+	"-49",
+	"234.567",
+	"2+3",
+	"2^3",
+	"2+3*4",
+	"2+3*4^5",
+	"(13 + 2) / 3",
+	"\"abc\"",
+	"'abd\\\"asra'",
+	"int(13 / 4)",
+	"int(13 / -(2+2)) + 1",
+	"int(13 / 4) + 1.0",
+	"$a[18].1",
+	"\"abc\\\"def\\\"ghi\"",
+	"$a>2",
+	"$a>=2",
+	"$a==int(13 / 4)",
+	"$a!=int(13 / 4)",
+	"$abc=2",
+	"2 + $a[17, int(3/-7)]"};
+
+// define arithmetic heavy expressions of the 2+3*4^5 family of eval.c, which the dispatch benchmark runs
+char *arithmetic[] = {
+	"2+3*4^5",
+	"2+3*4^5-6/7",
+	"(1+2)*(3+4)-5^2/6*7",
+	"1+2*3-4/5+6^2*7-8/3+9*10-11/12+13",
+	"-(2+3)*-(4-5)/(6+-7)^2"};
+
+// define the expressions of eval.c, which the soak benchmark evaluates
+char *evaluated[] = {
+	"234",
+	"-49",
+	"234.567",
+	"2+3",
+	"2^3",
+	"2+3*4",
+	"2+3*4^5",
+	"(13 + 2) / 3",
+	"\"abc\"",
+	"'abd\\\"asra'"};
+
+// keep the results of the timed loops, so the compiler can't drop them
+volatile long sink;
+
+// define the variable names the threads of the concurrent benchmarks look up, and the flag which stops them
+char *threadNames;
+long threadNameCount;
+atomic_int stopThreads;
+
+// define the store of the mixed workload benchmark and the percentage of its operations which are lookups
+shard_store mixedStore;
+int mixedReads;
+
+// return the processor time used so far, in seconds
+double seconds() {
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// return the wall clock time in seconds, which the partition benchmarks use since page faults and threads count there
+double wallSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// return the number of processors online, which bounds the speedup of the concurrent benchmarks
+long processors() {
+#ifdef _SC_NPROCESSORS_ONLN
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+#else
+	return 1;
+#endif
+}
+
+// return the next number of a pseudo random sequence, the same on every run
+unsigned long nextRandom(unsigned long *seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+// return a buffer holding the variable names v0 to v<count - 1>, BENCH_NAME_SIZE bytes apart, or NULL if out of memory
+char *benchNames(long count) {
+	char *names = (char *)malloc(count * BENCH_NAME_SIZE);
+	long i;
+	if (names == NULL) {
+		printf("Error: could not allocate %ld names\n", count);
+		return NULL;
+	}
+	for (i = 0; i < count; i++) {
+		sprintf(names + i * BENCH_NAME_SIZE, "v%ld", i);
+	}
+	return names;
+}
+
+// allocate a new empty partition of the specified size as the current one
+void newPartition(int size) {
+	patch[6] = size % 256;
+	patch[7] = size / 256;
+	alloc_partition();
+	init_partition();
+}
+
+// fill the current partition with integer variables named after their number, returning 0 or the first error code
+int fillPartition(char *names, long count) {
+	long i;
+	int err;
+	for (i = 0; i < count; i++) {
+		if ((err = emplace_int_var(names + i * BENCH_NAME_SIZE, (int)i)) != 0) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+// classify a character by scanning the character sets, the way the lexer did before the class table
+int scanClass(char c) {
+	int flags = 0;
+	if (strchr(spaces, c) != NULL) {
+		flags |= CC_SPACE;
+	}
+	if (strchr(unaries, c) != NULL) {
+		flags |= CC_UNARY;
+	}
+	if (strchr(num_chars, c) != NULL) {
+		flags |= CC_NUM;
+	}
+	if (strchr(op_chars, c) != NULL) {
+		flags |= CC_OP;
+	}
+	if (strchr(var_chars, c) != NULL) {
+		flags |= CC_VAR;
+	}
+	if (strchr(fun_chars, c) != NULL) {
+		flags |= CC_FUN;
+	}
+	return flags;
+}
+
+// benchmark the lexer over the corpus
+// the character classification is timed both with the class table and with the character set scans it replaced
+void benchLexer() {
+	int count = sizeof(corpus) / sizeof(char *);
+	long tokens = 0;
+	long bytes = 0;
+	long flags = 0;
+	double start, lexTime, tableTime, scanTime;
+	int round, i;
+	char *p;
+
+	// define a lexer context and a token vector reused by all the rounds
+	lexContext ctx;
+	tokenVector vector;
+
+	initVector(&vector);
+	start = seconds();
+	for (round = 0; round < LEXER_ROUNDS; round++) {
+		for (i = 0; i < count; i++) {
+			initContext(&ctx, corpus[i]);
+			vector.count = 0;
+			tokenize(&ctx, &vector);
+			tokens += vector.count;
+		}
+	}
+	lexTime = seconds() - start;
+	freeVector(&vector);
+	for (i = 0; i < count; i++) {
+		bytes += strlen(corpus[i]);
+	}
+	bytes *= LEXER_ROUNDS;
+
+	// classify every byte of the corpus with the table, then with the scans
+	start = seconds();
+	for (round = 0; round < LEXER_ROUNDS; round++) {
+		for (i = 0; i < count; i++) {
+			for (p = corpus[i]; *p; p++) {
+				flags += classOf(*p) & ~CC_STATE;
+			}
+		}
+	}
+	tableTime = seconds() - start;
+	start = seconds();
+	for (round = 0; round < LEXER_ROUNDS; round++) {
+		for (i = 0; i < count; i++) {
+			for (p = corpus[i]; *p; p++) {
+				flags += scanClass(*p);
+			}
+		}
+	}
+	scanTime = seconds() - start;
+	sink = flags;
+
+	printf("lexer: %ld tokens, %ld bytes in %.3fs, %.1f Mtokens/s, %.1f MB/s\n", tokens, bytes, lexTime, tokens / lexTime / 1e6, bytes / lexTime / 1e6);
+	printf("classification: table %.3fs, character set scans %.3fs, %.1fx faster\n", tableTime, scanTime, scanTime / tableTime);
+}
+
+// benchmark tokenize() and infixToPostfix() over expressions of 10 to 100k tokens
+// the time per token stays flat when appending a token takes constant time
+void benchScale() {
+	int sizes[] = {10, 100, 1000, 10000, 100000};
+	int s, i, rounds, round;
+	double start, tokenizeTime, postfixTime;
+	char *expr;
+
+	// define a lexer context and a token vector reused by all the rounds
+	lexContext ctx;
+	tokenVector vector;
+
+	initVector(&vector);
+	for (s = 0; s < (int)(sizeof(sizes) / sizeof(int)); s++) {
+		// build a sum of single digits, one short of the size when it is even so the expression ends with a number
+		expr = (char *)malloc(sizes[s] + 1);
+		if (expr == NULL) {
+			return;
+		}
+		for (i = 0; i < sizes[s]; i++) {
+			expr[i] = i & 1 ? '+' : '1' + i % 9;
+		}
+		expr[sizes[s] - (sizes[s] % 2 == 0)] = '\0';
+		rounds = SCALE_TOKENS / sizes[s];
+
+		start = seconds();
+		for (round = 0; round < rounds; round++) {
+			initContext(&ctx, expr);
+			vector.count = 0;
+			tokenize(&ctx, &vector);
+		}
+		tokenizeTime = seconds() - start;
+		start = seconds();
+		for (round = 0; round < rounds; round++) {
+			initContext(&ctx, expr);
+			vector.count = 0;
+			infixToPostfix(&ctx, &vector);
+		}
+		postfixTime = seconds() - start;
+		sink = vector.count;
+
+		printf("scale: %6d tokens, tokenize %.1f ns/token, infixToPostfix %.1f ns/token\n", vector.count, tokenizeTime * 1e9 / rounds / vector.count, postfixTime * 1e9 / rounds / vector.count);
+		free(expr);
+	}
+	freeVector(&vector);
+}
+
+// run the dispatch benchmark programs with a bytecode loop, returning the processor time taken
+double timeDispatch(int (*run)(program *, valueStack *), program *progs, int count) {
+	valueStack stack;
+	double start;
+	int i, round;
+
+	initValueStack(&stack);
+	start = seconds();
+	for (round = 0; round < DISPATCH_ROUNDS; round++) {
+		for (i = 0; i < count; i++) {
+			stack.count = 0;
+			run(&progs[i], &stack);
+		}
+	}
+	sink = stack.count;
+	return seconds() - start;
+}
+
+// benchmark the bytecode loop on the arithmetic expressions, with the portable switch and with direct threading
+void benchDispatch() {
+	int count = sizeof(arithmetic) / sizeof(char *);
+	long instructions = 0;
+	double switchTime;
+	int i, pc;
+
+	// define the lexer context and the programs
+	lexContext ctx;
+	program progs[sizeof(arithmetic) / sizeof(char *)];
+
+	// compile the expressions without optimizing them, so they aren't folded into constants
+	for (i = 0; i < count; i++) {
+		initContext(&ctx, arithmetic[i]);
+		if (compileExpr(&ctx, &progs[i]) != ERROR_NONE) {
+			printf("Error: could not compile %s\n", arithmetic[i]);
+			return;
+		}
+		for (pc = 0; progs[i].code[pc] != OP_END; pc += instructionSize(progs[i].code[pc])) {
+			instructions++;
+		}
+	}
+	instructions *= DISPATCH_ROUNDS;
+
+	switchTime = timeDispatch(executeSwitch, progs, count);
+	printf("dispatch: %ld instructions, switch %.2f ns/instruction", instructions, switchTime * 1e9 / instructions);
+#ifdef COMPUTED_GOTO
+	double gotoTime = timeDispatch(execute, progs, count);
+	printf(", computed goto %.2f ns/instruction, %.2fx faster\n", gotoTime * 1e9 / instructions, switchTime / gotoTime);
+#else
+	printf(", computed goto not available in this build\n");
+#endif
+	for (i = 0; i < count; i++) {
+		freeProgram(&progs[i]);
+	}
+}
+
+// return the size in KiB a /proc file gives on the line of the specified field, or -1 where it isn't available
+long procKiB(char *path, char *field) {
+	char line[128];
+	long kib = -1;
+	size_t size = strlen(field);
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (strncmp(line, field, size) == 0) {
+			kib = atol(line + size);
+			break;
+		}
+	}
+	fclose(f);
+	return kib;
+}
+
+// return the resident set size of the process in KiB, or -1 where /proc isn't available
+long residentKiB() {
+	return procKiB("/proc/self/status", "VmRSS:");
+}
+
+// return the number of bytes held by the blocks of an arena
+long arenaBytes(arena *pool) {
+	arenaBlock *block;
+	long bytes = 0;
+	for (block = pool->first; block != NULL; block = block->next) {
+		bytes += block->size;
+	}
+	return bytes;
+}
+
+// evaluate the eval.c expressions over and over with an arena, reporting the memory use along the way
+// the resident set size and the arena stay flat when every evaluation releases all its memory
+void benchSoak(long evals) {
+	int count = sizeof(evaluated) / sizeof(char *);
+	long n;
+	double start = seconds();
+
+	// define the lexer context, the arena and the value stack
+	lexContext ctx;
+	arena pool;
+	valueStack results;
+
+	initArena(&pool);
+	for (n = 1; n <= evals; n++) {
+		initContext(&ctx, evaluated[n % count]);
+		ctx.pool = &pool;
+		initValueStack(&results);
+		eval(&ctx, &results);
+		if (n % (evals / SOAK_REPORTS > 0 ? evals / SOAK_REPORTS : 1) == 0) {
+			printf("soak: %ld evaluations, %.1fs, resident %ld KiB, arena %ld bytes\n", n, seconds() - start, residentKiB(), arenaBytes(&pool));
+		}
+	}
+	freeArena(&pool);
+}
+
+// return the average number of index slots a lookup of each variable of the current partition goes through
+double averageProbes(char *names, long count) {
+	long probes = 0;
+	long i;
+	psize_t *slot;
+	char *name;
+	for (i = 0; i < count; i++) {
+		name = names + i * BENCH_NAME_SIZE;
+		slot = find_slot(name, strlen(name));
+		probes += (slot - vIndex - hash_name(name, strlen(name)) + iSize) % iSize + 1;
+	}
+	return (double)probes / count;
+}
+
+// benchmark find_var() and delete_var() on partitions of 10 to 10k variables
+// the probe chains stay short as the index grows, so the time per lookup and per delete only rises as the partition and
+// the index outgrow the processor caches
+void benchLookup() {
+	long counts[] = {10, 100, 1000, 10000};
+	unsigned long seed;
+	long count, n, deletes, found;
+	double start, lookupTime, deleteTime, probes;
+	char *names;
+	int s;
+
+	for (s = 0; s < (int)(sizeof(counts) / sizeof(long)); s++) {
+		count = counts[s];
+		if ((names = benchNames(count)) == NULL) {
+			return;
+		}
+		newPartition(BENCH_PARTITION_SIZE);
+		if (fillPartition(names, count) != 0) {
+			free_partition();
+			free(names);
+			return;
+		}
+
+		// look random variables up
+		probes = averageProbes(names, count);
+		seed = 1;
+		found = 0;
+		start = wallSeconds();
+		for (n = 0; n < LOOKUP_OPS; n++) {
+			found += find_var(names + nextRandom(&seed) % count * BENCH_NAME_SIZE) != NULL;
+		}
+		lookupTime = wallSeconds() - start;
+
+		// delete all the variables, adding them back between the rounds without timing it
+		deleteTime = 0;
+		for (deletes = 0; deletes < LOOKUP_DELETES; deletes += count) {
+			start = wallSeconds();
+			for (n = 0; n < count; n++) {
+				found += delete_var(names + n * BENCH_NAME_SIZE);
+			}
+			deleteTime += wallSeconds() - start;
+			fillPartition(names, count);
+		}
+		sink = found;
+
+		printf("lookup: %5ld variables, index %5lu slots, %.2f probes, find_var %.1f ns, delete_var %.1f ns\n", count, (unsigned long)iSize, probes, lookupTime * 1e9 / LOOKUP_OPS, deleteTime * 1e9 / deletes);
+		free_partition();
+		free(names);
+	}
+}
+
+// benchmark the allocator with a random mix of adds and deletes, with integer values, which all take the same size, and
+// with strings of random lengths, which have to be split from larger deleted blocks
+void benchChurn() {
+	char value[CHURN_STRING + 1];
+	char live[CHURN_NAMES];
+	unsigned long seed, r, startCompactions;
+	long n, allocations, size;
+	double start, elapsed, startCompactSeconds;
+	char *names, *name;
+	int strings, length;
+
+	if ((names = benchNames(CHURN_NAMES)) == NULL) {
+		return;
+	}
+	for (strings = 0; strings <= 1; strings++) {
+		// size the partition from the average element, with names of about 4 characters
+		size = (long)(ELEMENT_HEADER_SIZE + 3 + 4 + (strings ? CHURN_STRING / 2 : sizeof(int))) * CHURN_NAMES / 2 * 100 / CHURN_FILL;
+		newPartition(size);
+		memset(live, 0, sizeof(live));
+		seed = 1;
+		allocations = 0;
+		startCompactions = compactions;
+		startCompactSeconds = compactSeconds;
+		start = wallSeconds();
+		for (n = 0; n < CHURN_OPS; n++) {
+			r = nextRandom(&seed);
+			name = names + r % CHURN_NAMES * BENCH_NAME_SIZE;
+			if (live[r % CHURN_NAMES]) {
+				delete_var(name);
+				live[r % CHURN_NAMES] = 0;
+				continue;
+			}
+			if (strings) {
+				length = (r >> 10) % (CHURN_STRING + 1);
+				memset(value, 'a' + length % 26, length);
+				value[length] = '\0';
+				live[r % CHURN_NAMES] = emplace_string_var(name, value) == 0;
+			} else {
+				live[r % CHURN_NAMES] = emplace_int_var(name, (int)n) == 0;
+			}
+			allocations++;
+		}
+		elapsed = wallSeconds() - start;
+
+		printf("churn: %s, %ld allocations, %.2f M allocations/s, %lu compactions, one per %ld allocations, %.1f%% of the time compacting, partition of %ld bytes, %lu at the end\n",
+			strings ? "strings of 0 to 40 bytes" : "integers", allocations, allocations / elapsed / 1e6, compactions - startCompactions,
+			compactions > startCompactions ? allocations / (long)(compactions - startCompactions) : allocations,
+			(compactSeconds - startCompactSeconds) * 100 / elapsed, size, (unsigned long)pSize);
+		free_partition();
+	}
+	free(names);
+}
+
+// benchmark adding, looking up and deleting variables in wide partitions of 1 MB to 100 MB
+// the partitions start small and grow as they fill, the time spent growing them counts in the adds
+void benchWide() {
+	int sizes[] = {1, 10, 100};
+	char value[WIDE_STRING + 1];
+	unsigned long seed;
+	long count, n, found;
+	double start, addTime, lookupTime, deleteTime;
+	char *names;
+	int s;
+
+	memset(value, 'w', WIDE_STRING);
+	value[WIDE_STRING] = '\0';
+	for (s = 0; s < (int)(sizeof(sizes) / sizeof(int)); s++) {
+		// each variable takes its value, its name of up to 8 characters and 3 size and type bytes, plus the element header
+		count = sizes[s] * 1000000L / (ELEMENT_HEADER_SIZE + 3 + 8 + WIDE_STRING);
+		if ((names = benchNames(count)) == NULL) {
+			return;
+		}
+		newPartition(BENCH_PARTITION_SIZE);
+		found = 0;
+		start = wallSeconds();
+		for (n = 0; n < count; n++) {
+			if (emplace_string_var(names + n * BENCH_NAME_SIZE, value) != 0) {
+				break;
+			}
+		}
+		addTime = wallSeconds() - start;
+		if (n < count) {
+			printf("wide: could not add %ld variables\n", count);
+			free_partition();
+			free(names);
+			return;
+		}
+
+		seed = 1;
+		start = wallSeconds();
+		for (n = 0; n < WIDE_LOOKUPS; n++) {
+			found += find_var(names + nextRandom(&seed) % count * BENCH_NAME_SIZE) != NULL;
+		}
+		lookupTime = wallSeconds() - start;
+
+		printf("wide: %3d MB, %6ld variables, partition %9lu bytes, index %7lu slots, ", sizes[s], count, (unsigned long)pSize, (unsigned long)iSize);
+
+		// delete them in the order they were added, each one merges with the block of the one before
+		start = wallSeconds();
+		for (n = 0; n < count; n++) {
+			found += delete_var(names + n * BENCH_NAME_SIZE);
+		}
+		deleteTime = wallSeconds() - start;
+		sink = found;
+
+		printf("add %.1f ns, find_var %.1f ns, delete_var %.1f ns\n", addTime * 1e9 / count, lookupTime * 1e9 / WIDE_LOOKUPS, deleteTime * 1e9 / count);
+		free_partition();
+		free(names);
+	}
+}
+
+// benchmark starting with a partition of 1k to 100k variables, rebuilt with load_int_var() and add_var(), or loaded from a
+// snapshot with load_partition(), with and without verifying its checksum
+// a load maps the snapshot without reading it, so the first lookup of each variable afterwards is timed as well
+void benchStartup() {
+	long counts[] = {1000, 10000, 100000};
+	long count, n, found;
+	double start, rebuildTime, loadTime, lookupTime, verifyTime;
+	char *names;
+	int s, round;
+
+	for (s = 0; s < (int)(sizeof(counts) / sizeof(long)); s++) {
+		count = counts[s];
+		if ((names = benchNames(count)) == NULL) {
+			return;
+		}
+		found = 0;
+		rebuildTime = loadTime = lookupTime = verifyTime = 0;
+		for (round = 0; round < STARTUP_ROUNDS; round++) {
+			start = wallSeconds();
+			newPartition(BENCH_PARTITION_SIZE);
+			for (n = 0; n < count; n++) {
+				load_int_var(vBuf1, names + n * BENCH_NAME_SIZE, (int)n);
+				add_var(vBuf1);
+			}
+			rebuildTime += wallSeconds() - start;
+			if (round == 0 && save_partition(STARTUP_PATH) != 0) {
+				free_partition();
+				free(names);
+				return;
+			}
+			free_partition();
+
+			start = wallSeconds();
+			if (load_partition(STARTUP_PATH, false) != 0) {
+				break;
+			}
+			loadTime += wallSeconds() - start;
+			start = wallSeconds();
+			for (n = 0; n < count; n++) {
+				found += find_var(names + n * BENCH_NAME_SIZE) != NULL;
+			}
+			lookupTime += wallSeconds() - start;
+			free_partition();
+
+			start = wallSeconds();
+			if (load_partition(STARTUP_PATH, true) != 0) {
+				break;
+			}
+			verifyTime += wallSeconds() - start;
+			free_partition();
+		}
+		sink = found;
+
+		if (round == STARTUP_ROUNDS) {
+			printf("startup: %6ld variables, rebuild with add_var %.3f ms, load_partition %.3f ms, verified %.3f ms, first lookup of each variable after loading %.3f ms\n",
+				count, rebuildTime * 1e3 / STARTUP_ROUNDS, loadTime * 1e3 / STARTUP_ROUNDS, verifyTime * 1e3 / STARTUP_ROUNDS, lookupTime * 1e3 / STARTUP_ROUNDS);
+		}
+		free(names);
+	}
+	remove(STARTUP_PATH);
+}
+
+// benchmark each partition allocation backend on a large partition, with and without prefaulting the pages
+// the allocation includes the page faults when prefaulting, otherwise they happen while filling the partition; the scans
+// walk every element like get_fragmentation() does and the lookups jump around the partition, both depend on the TLB reach
+void benchBackends() {
+	char value[WIDE_STRING + 1];
+	psize_t freeBytes, freeBlocks, largest;
+	unsigned long seed;
+	long count, n, found;
+	double start, allocTime, fillTime, scanTime, lookupTime;
+	char *names;
+	int backend, prefault;
+
+	memset(value, 'b', WIDE_STRING);
+	value[WIDE_STRING] = '\0';
+	count = BACKEND_MB * 1000000L / (ELEMENT_HEADER_SIZE + 3 + 8 + WIDE_STRING);
+	if ((names = benchNames(count)) == NULL) {
+		return;
+	}
+	for (backend = BACKEND_MALLOC; backend <= BACKEND_HUGETLB; backend++) {
+		for (prefault = 0; prefault <= 1; prefault++) {
+			set_partition_backend(backend, prefault);
+			newPartition(BENCH_PARTITION_SIZE);
+			// grow the partition to its full size at once, so it's a single allocation from the backend
+			start = wallSeconds();
+			if (!grow_partition(BACKEND_MB * 1048576L - pSize)) {
+				printf("Error: could not grow the partition to %d MB\n", BACKEND_MB);
+				break;
+			}
+			allocTime = wallSeconds() - start;
+			found = 0;
+			start = wallSeconds();
+			for (n = 0; n < count; n++) {
+				found += emplace_string_var(names + n * BENCH_NAME_SIZE, value) == 0;
+			}
+			fillTime = wallSeconds() - start;
+
+			start = wallSeconds();
+			for (n = 0; n < BACKEND_SCANS; n++) {
+				get_fragmentation(&freeBytes, &freeBlocks, &largest);
+				found += freeBlocks;
+			}
+			scanTime = wallSeconds() - start;
+			seed = 1;
+			start = wallSeconds();
+			for (n = 0; n < BACKEND_LOOKUPS; n++) {
+				found += find_var(names + nextRandom(&seed) % count * BENCH_NAME_SIZE) != NULL;
+			}
+			lookupTime = wallSeconds() - start;
+			sink = found;
+
+			printf("backend: %-8s from %-8s %-13s alloc %6.2f ms, fill %6.1f ms, scan %5.2f ms, find_var %5.1f ns\n", backendNames[backend], backendNames[pAllocBackend],
+				prefault ? "prefaulted," : "on demand,", allocTime * 1e3, fillTime * 1e3, scanTime * 1e3 / BACKEND_SCANS, lookupTime * 1e9 / BACKEND_LOOKUPS);
+			free_partition();
+		}
+	}
+	set_partition_backend(BACKEND_MALLOC, false);
+	free(names);
+}
+
+// reader thread of the reader scaling benchmark, looks random variables up in the current version until stopped
+// return the number of lookups
+void *versionReader(void *arg) {
+	int slot = (int)(long)arg;
+	unsigned long seed = slot + 1;
+	long lookups = 0;
+	long found = 0;
+	char vBuf[3 + 255 + 255];
+	mvcc_version *v;
+	int i;
+
+	while (!atomic_load(&stopThreads)) {
+		v = mvcc_acquire(slot);
+		for (i = 0; i < READERS_LOOKUPS; i++) {
+			found += mvcc_find_var(v, threadNames + nextRandom(&seed) % threadNameCount * BENCH_NAME_SIZE, vBuf);
+		}
+		mvcc_release(slot);
+		lookups += READERS_LOOKUPS;
+	}
+	sink = found;
+	return (void *)lookups;
+}
+
+// benchmark lookups in copy-on-write versions with 1 to MVCC_MAX_READERS reader threads, while the writer changes a
+// variable and publishes a new version every millisecond or so
+// readers never lock, so the lookups per second grow with the threads as long as there are processors to run them
+void benchReaders() {
+	struct timespec pause = {0, READERS_PAUSE_US * 1000};
+	pthread_t ids[MVCC_MAX_READERS];
+	unsigned long seed = 1;
+	long lookups, publishes;
+	double start, elapsed;
+	void *result;
+	int readers, i;
+
+	threadNameCount = READERS_VARS;
+	if ((threadNames = benchNames(threadNameCount)) == NULL) {
+		return;
+	}
+	newPartition(BENCH_PARTITION_SIZE);
+	if (fillPartition(threadNames, threadNameCount) != 0 || !mvcc_publish()) {
+		printf("Error: could not publish the partition\n");
+		free_partition();
+		free(threadNames);
+		return;
+	}
+	for (readers = 1; readers <= MVCC_MAX_READERS; readers *= 2) {
+		atomic_store(&stopThreads, 0);
+		for (i = 0; i < readers; i++) {
+			if (pthread_create(&ids[i], NULL, versionReader, (void *)(long)i) != 0) {
+				printf("Error: could not start reader %d\n", i);
+				atomic_store(&stopThreads, 1);
+				readers = i;
+				break;
+			}
+		}
+		publishes = 0;
+		start = wallSeconds();
+		while ((elapsed = wallSeconds() - start) < READERS_MS / 1e3) {
+			update_int_var(threadNames + nextRandom(&seed) % threadNameCount * BENCH_NAME_SIZE, (int)publishes);
+			mvcc_publish();
+			publishes++;
+			nanosleep(&pause, NULL);
+		}
+		atomic_store(&stopThreads, 1);
+		lookups = 0;
+		for (i = 0; i < readers; i++) {
+			pthread_join(ids[i], &result);
+			lookups += (long)result;
+		}
+		elapsed = wallSeconds() - start;
+		printf("readers: %2d threads on %ld processors, %6.2f M lookups/s, %6.2f M lookups/s per reader, %ld publishes/s\n", readers, processors(),
+			lookups / elapsed / 1e6, lookups / elapsed / 1e6 / readers, (long)(publishes / elapsed));
+	}
+	mvcc_free();
+	free_partition();
+	free(threadNames);
+}
+
+// worker thread of the mixed workload benchmark, looks variables up, sets them and deletes them until stopped
+// one write in eight is a delete and the others are sets, which add the variables that are missing, so most variables exist
+// return the number of operations
+void *mixedWorker(void *arg) {
+	unsigned long seed = (unsigned long)(long)arg + 1;
+	unsigned long r;
+	long ops = 0;
+	long found = 0;
+	char vBuf[3 + 255 + 255];
+	char *name;
+	int value;
+
+	while (!atomic_load(&stopThreads)) {
+		r = nextRandom(&seed);
+		name = threadNames + r % threadNameCount * BENCH_NAME_SIZE;
+		if ((int)((r >> 14) % 100) < mixedReads) {
+			found += shard_find_var(&mixedStore, name, vBuf);
+		} else if ((r >> 14) % 8 != 0) {
+			value = (int)ops;
+			shard_update_var(&mixedStore, 0x03, name, sizeof(int), (char *)&value);
+		} else {
+			found += shard_delete_var(&mixedStore, name);
+		}
+		ops++;
+	}
+	sink = found;
+	return (void *)ops;
+}
+
+// benchmark the sharded store with 1 to MIXED_THREADS threads, on a read mostly and on a write heavy mix of operations
+// threads on different shards never wait for each other, so the operations per second grow with the threads as long as
+// there are processors to run them
+void benchMixed() {
+	struct timespec pause = {MIXED_MS / 1000, MIXED_MS % 1000 * 1000000L};
+	int reads[] = {90, 50};
+	pthread_t ids[MIXED_THREADS];
+	long ops, n;
+	double start, elapsed;
+	void *result;
+	int m, threads, i;
+
+	threadNameCount = MIXED_VARS;
+	if ((threadNames = benchNames(threadNameCount)) == NULL) {
+		return;
+	}
+	patch[6] = BENCH_PARTITION_SIZE % 256;
+	patch[7] = BENCH_PARTITION_SIZE / 256;
+	for (m = 0; m < (int)(sizeof(reads) / sizeof(int)); m++) {
+		mixedReads = reads[m];
+		for (threads = 1; threads <= MIXED_THREADS; threads *= 2) {
+			// start each step from a full store
+			if (!shard_init(&mixedStore, DEF_SHARD_COUNT)) {
+				break;
+			}
+			for (n = 0; n < threadNameCount; n++) {
+				load_int_var(vBuf1, threadNames + n * BENCH_NAME_SIZE, (int)n);
+				shard_add_var(&mixedStore, vBuf1);
+			}
+			atomic_store(&stopThreads, 0);
+			start = wallSeconds();
+			for (i = 0; i < threads; i++) {
+				if (pthread_create(&ids[i], NULL, mixedWorker, (void *)(long)i) != 0) {
+					printf("Error: could not start thread %d\n", i);
+					threads = i;
+					break;
+				}
+			}
+			nanosleep(&pause, NULL);
+			atomic_store(&stopThreads, 1);
+			ops = 0;
+			for (i = 0; i < threads; i++) {
+				pthread_join(ids[i], &result);
+				ops += (long)result;
+			}
+			elapsed = wallSeconds() - start;
+			printf("mixed: %d%% lookups, %2d threads on %ld processors, %d shards, %6.2f M ops/s, %6.2f M ops/s per thread\n", mixedReads, threads, processors(),
+				mixedStore.count, ops / elapsed / 1e6, ops / elapsed / 1e6 / threads);
+			shard_free(&mixedStore);
+		}
+	}
+	free(threadNames);
+}
+
+#ifdef HAVE_MMAP
+// define what a worker of the shared partition benchmark reports
+typedef struct workerReport {
+	long found;         // number of variables the worker found
+	double warmUp;      // time the worker took to get its variables and look each one up, in seconds
+	long residentKiB;   // resident set size
+	long proportionalKiB; // resident set size with the pages shared with other processes divided between them, or -1
+} workerReport;
+
+// worker process of the shared partition benchmark, builds its own partition or attaches to the shared segment, looks
+// every variable up, then waits for the other workers, so they all map the shared pages when it measures its memory
+void memoryWorker(char *segment, char *names, int ready, int go, int reports) {
+	char vBuf[3 + 255 + 255];
+	char value[WORKER_STRING + 1];
+	workerReport report;
+	shared_segment seg;
+	double start = wallSeconds();
+	long n;
+	char c = 0;
+
+	report.found = 0;
+	if (segment == NULL) {
+		memset(value, 'p', WORKER_STRING);
+		value[WORKER_STRING] = '\0';
+		newPartition(BENCH_PARTITION_SIZE);
+		for (n = 0; n < WORKER_VARS; n++) {
+			emplace_string_var(names + n * BENCH_NAME_SIZE, value);
+		}
+		for (n = 0; n < WORKER_VARS; n++) {
+			report.found += find_var(names + n * BENCH_NAME_SIZE) != NULL;
+		}
+	} else if (shared_attach(&seg, segment) == 0) {
+		for (n = 0; n < WORKER_VARS; n++) {
+			report.found += shared_find_var(&seg, names + n * BENCH_NAME_SIZE, vBuf, sizeof(vBuf));
+		}
+	}
+	report.warmUp = wallSeconds() - start;
+
+	// tell the parent this worker is ready, and wait until it closes the pipe when all of them are
+	if (write(ready, &c, 1) != 1 || read(go, &c, 1) < 0) {
+		_exit(1);
+	}
+	report.residentKiB = residentKiB();
+	report.proportionalKiB = procKiB("/proc/self/smaps_rollup", "Pss:");
+	_exit(write(reports, &report, sizeof(report)) != sizeof(report));
+}
+
+// benchmark the memory each worker process of a pool takes, with a partition of its own and with the shared partition
+// a worker of the shared partition only maps the segment, so its own memory stays about the same whatever the number of
+// workers, and the proportional size divides the segment between them
+void benchShared() {
+	char value[WORKER_STRING + 1];
+	char segment[32];
+	int ready[2], go[2], reports[2];
+	workerReport report;
+	long found, resident, proportional;
+	double warmUp;
+	char *names;
+	pid_t pid;
+	char c;
+	int shared, i, workers;
+
+	if ((names = benchNames(WORKER_VARS)) == NULL) {
+		return;
+	}
+	memset(value, 'p', WORKER_STRING);
+	value[WORKER_STRING] = '\0';
+	sprintf(segment, "/orbbench%d", (int)getpid());
+	for (shared = 0; shared <= 1; shared++) {
+		// the writer fills the shared segment, a worker of its own partition fills it itself
+		if (shared) {
+			shared_unlink(segment);
+			if (shared_create(segment, WORKER_VARS * (ELEMENT_HEADER_SIZE + 3 + 8 + WORKER_STRING)) != 0) {
+				break;
+			}
+			for (i = 0; i < WORKER_VARS; i++) {
+				shared_update_var(0x05, names + i * BENCH_NAME_SIZE, WORKER_STRING, value);
+			}
+		}
+		if (pipe(ready) != 0 || pipe(go) != 0 || pipe(reports) != 0) {
+			printf("Error: could not create the worker pipes\n");
+			break;
+		}
+		fflush(stdout);
+		for (workers = 0; workers < WORKERS; workers++) {
+			if ((pid = fork()) == 0) {
+				close(ready[0]);
+				close(go[1]);
+				close(reports[0]);
+				memoryWorker(shared ? segment : NULL, names, ready[1], go[0], reports[1]);
+			}
+			if (pid < 0) {
+				printf("Error: could not start worker %d\n", workers);
+				break;
+			}
+		}
+		close(ready[1]);
+		close(go[0]);
+		close(reports[1]);
+
+		// let the workers measure their memory once they are all ready
+		for (i = 0; i < workers && read(ready[0], &c, 1) == 1; i++) {
+		}
+		close(go[1]);
+		found = resident = proportional = 0;
+		warmUp = 0;
+		for (i = 0; i < workers && read(reports[0], &report, sizeof(report)) == sizeof(report); i++) {
+			found += report.found;
+			warmUp += report.warmUp;
+			resident += report.residentKiB;
+			proportional += report.proportionalKiB;
+		}
+		close(ready[0]);
+		close(reports[0]);
+		while (wait(NULL) > 0) {
+		}
+		if (shared) {
+			free_partition();
+			shared_unlink(segment);
+		}
+		if (i < workers || found != (long)workers * WORKER_VARS) {
+			printf("Error: %d of %d workers reported, %ld variables found\n", i, workers, found);
+			break;
+		}
+		printf("workers: %d with %-22s %d variables, warm-up %6.2f ms, resident %6ld KiB, proportional %6ld KiB per worker\n", workers,
+			shared ? "the shared partition," : "a partition each,", WORKER_VARS, warmUp * 1e3 / workers, resident / workers, proportional / workers);
+	}
+	free(names);
+}
+#endif
+
+// main program
+// run the benchmark named on the command line, or all of them
+int main(int argc, char *argv[]) {
+	char *name = argc > 1 ? argv[1] : "all";
+	int all = strcmp(name, "all") == 0;
+	int found = all;
+
+	if (all || strcmp(name, "lexer") == 0) {
+		benchLexer();
+		found = 1;
+	}
+	if (all || strcmp(name, "scale") == 0) {
+		benchScale();
+		found = 1;
+	}
+	if (all || strcmp(name, "dispatch") == 0) {
+		benchDispatch();
+		found = 1;
+	}
+	if (all || strcmp(name, "lookup") == 0) {
+		benchLookup();
+		found = 1;
+	}
+	if (all || strcmp(name, "churn") == 0) {
+		benchChurn();
+		found = 1;
+	}
+	if (all || strcmp(name, "startup") == 0) {
+		benchStartup();
+		found = 1;
+	}
+	if (all || strcmp(name, "backend") == 0) {
+		benchBackends();
+		found = 1;
+	}
+	if (all || strcmp(name, "readers") == 0) {
+		benchReaders();
+		found = 1;
+	}
+	if (all || strcmp(name, "mixed") == 0) {
+		benchMixed();
+		found = 1;
+	}
+#ifdef HAVE_MMAP
+	if (all || strcmp(name, "shared") == 0) {
+		benchShared();
+		found = 1;
+	}
+#endif
+	// the scaling benchmark takes a few hundred MB, and the soak benchmark runs for a while, so they only run when asked for
+	if (strcmp(name, "wide") == 0) {
+		benchWide();
+		found = 1;
+	}
+	if (strcmp(name, "soak") == 0) {
+		benchSoak(argc > 2 ? atol(argv[2]) : SOAK_EVALS);
+		found = 1;
+	}
+	if (!found) {
+		printf("Usage: bench [all|lexer|scale|dispatch|lookup|churn|startup|backend|readers|mixed|shared|wide] or bench soak [evaluations]\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,256 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <math.h>
+#include "token.h"
+#include "postfix.h"
+#include "value.h"
+
+// enumerate the opcodes
+// OP_INT and OP_FLOAT are followed by their value, OP_STRING and OP_VARIABLE by the offset and length of their text in the expression
+enum opCodes {
+	OP_END,
+	OP_INT,
+	OP_FLOAT,
+	OP_STRING,
+	OP_VARIABLE,
+	OP_NEG,
+	OP_POS,
+	OP_ADD,
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_POW,
+	OP_MOD
+};
+
+// compiled expression
+typedef struct program {
+	unsigned char *code; // bytecode, terminated by OP_END
+	int size;			 // number of bytes used
+	int capacity;		 // number of bytes allocated
+	int depth;			 // maximum number of values on the stack while running
+	int removed;		 // number of instructions removed by the optimizer
+	char *expr;			 // expression the text references point into
+	arena *pool;		 // arena the code comes from, or NULL for the heap
+} program;
+
+// initialize an empty program
+void initProgram(program *prog, char *expr) {
+	prog->code	   = NULL;
+	prog->size	   = 0;
+	prog->capacity = 0;
+	prog->depth	   = 0;
+	prog->removed  = 0;
+	prog->expr	   = expr;
+	prog->pool	   = NULL;
+}
+
+// free the memory of a program
+// programs compiled into an arena are released with the arena
+void freeProgram(program *prog) {
+	arena *pool = prog->pool;
+	if (pool == NULL) {
+		free(prog->code);
+	}
+	initProgram(prog, prog->expr);
+	prog->pool = pool;
+}
+
+// append bytes to the program, doubling its capacity when full
+int emitBytes(program *prog, void *bytes, int size) {
+	unsigned char *code;
+	int capacity;
+	if (prog->size + size > prog->capacity) {
+		capacity = prog->capacity ? prog->capacity : 64;
+		while (prog->size + size > capacity) {
+			capacity *= 2;
+		}
+		if (prog->pool != NULL) {
+			code = (unsigned char *)arenaRealloc(prog->pool, prog->code, prog->capacity, capacity);
+		} else {
+			code = (unsigned char *)realloc(prog->code, capacity);
+		}
+		if (code == NULL) {
+			return ERROR_OUT_OF_MEMORY;
+		}
+		prog->code	   = code;
+		prog->capacity = capacity;
+	}
+	memcpy(prog->code + prog->size, bytes, size);
+	prog->size += size;
+	return ERROR_NONE;
+}
+
+// return the size of an instruction, including its inline operands
+int instructionSize(unsigned char op) {
+	switch (op) {
+	case OP_INT:
+		return 1 + sizeof(long);
+	case OP_FLOAT:
+		return 1 + sizeof(double);
+	case OP_STRING:
+	case OP_VARIABLE:
+		return 1 + 2 * sizeof(int);
+	default:
+		return 1;
+	}
+}
+
+// append an opcode to the program
+int emitOp(program *prog, unsigned char op) {
+	return emitBytes(prog, &op, 1);
+}
+
+// append an opcode followed by a reference to a span of the expression
+int emitSpan(program *prog, unsigned char op, tokenSpan *span) {
+	int error;
+	if ((error = emitOp(prog, op)) != ERROR_NONE) {
+		return error;
+	}
+	if ((error = emitBytes(prog, &span->offset, sizeof(int))) != ERROR_NONE) {
+		return error;
+	}
+	return emitBytes(prog, &span->length, sizeof(int));
+}
+
+// opcodes, indexed by operator code
+// operators the evaluator doesn't support map to OP_END
+static const unsigned char opCodeTable[] = {
+	OP_END, // OPR_NONE
+	OP_END, // OPR_UNKNOWN
+	OP_NEG, // OPR_NEG
+	OP_POS, // OPR_POS
+	OP_END, // OPR_NOT
+	OP_POW, // OPR_POW
+	OP_MUL, // OPR_MUL
+	OP_DIV, // OPR_DIV
+	OP_MOD, // OPR_MOD
+	OP_ADD, // OPR_ADD
+	OP_SUB, // OPR_SUB
+	OP_END, // OPR_GT
+	OP_END, // OPR_GE
+	OP_END, // OPR_LT
+	OP_END, // OPR_LE
+	OP_END, // OPR_EQ
+	OP_END, // OPR_NE
+	OP_END	// OPR_ASSIGN
+};
+
+// compile an expression into a program
+// the stack depth is checked here, so running the program never underflows the stack
+int compileExpr(lexContext *ctx, program *prog) {
+	// define the current postfix token
+	tokenSpan *span = NULL;
+	unsigned char code;
+	int depth = 0;
+	int i;
+
+	// define a token vector for the postfix expression
+	tokenVector postfix;
+
+	// define an error code
+	int error = 0;
+
+	initProgram(prog, ctx->expr);
+	prog->pool = ctx->pool;
+	initVector(&postfix);
+	postfix.pool = ctx->pool;
+	if ((error = infixToPostfix(ctx, &postfix)) != ERROR_NONE) {
+		freeVector(&postfix);
+		return error;
+	}
+
+	for (i = 0; i < postfix.count && error == ERROR_NONE; i++) {
+		span = &postfix.items[i];
+		// numbers are stored inline with their decoded value
+		if (span->type == TOKEN_NUMBER) {
+			if (span->isFloat) {
+				if ((error = emitOp(prog, OP_FLOAT)) == ERROR_NONE) {
+					error = emitBytes(prog, &span->num.real, sizeof(double));
+				}
+			} else {
+				if ((error = emitOp(prog, OP_INT)) == ERROR_NONE) {
+					error = emitBytes(prog, &span->num.integer, sizeof(long));
+				}
+			}
+			depth++;
+		}
+		// strings and variables reference their text in the expression
+		else if (span->type == TOKEN_STRING || span->type == TOKEN_VARIABLE) {
+			error = emitSpan(prog, span->type == TOKEN_STRING ? OP_STRING : OP_VARIABLE, span);
+			depth++;
+		}
+		// unaries take one operand and operators take two, both leave one result
+		else if (span->type == TOKEN_UNARY || span->type == TOKEN_OPERATOR) {
+			if ((code = opCodeTable[span->op]) == OP_END) {
+				error = ERROR_UNKNOWN_OPERATOR;
+			} else if (depth < (span->type == TOKEN_UNARY ? 1 : 2)) {
+				error = ERROR_STACK_UNDERFLOW;
+			} else {
+				error = emitOp(prog, code);
+				depth -= span->type == TOKEN_UNARY ? 0 : 1;
+			}
+		}
+		if (depth > prog->depth) {
+			prog->depth = depth;
+		}
+	}
+	freeVector(&postfix);
+	if (error == ERROR_NONE) {
+		error = emitOp(prog, OP_END);
+	}
+	if (error != ERROR_NONE) {
+		freeProgram(prog);
+	}
+	return error;
+}
+
+// return true if the two values at the top of the stack are numbers
+int numericPair(value *top) {
+	return isNumeric(top - 1) && isNumeric(top);
+}
+
+// select the dispatch of the bytecode loop
+// GCC and Clang jump straight from one instruction to the next through a table of label addresses (direct threading)
+// other compilers, or builds with NO_COMPUTED_GOTO defined, use a portable switch
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define COMPUTED_GOTO
+#endif
+
+// build the portable switch loop as executeSwitch(), always, so the two dispatches can be compared in one build
+#define EXECUTE_NAME executeSwitch
+#define VM_LOOP for (;;) switch (*pc++)
+#define VM_CASE(op) case op:
+#define VM_DEFAULT default:
+#define VM_NEXT continue
+#include "execute.h"
+#undef EXECUTE_NAME
+#undef VM_LOOP
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_NEXT
+
+#ifdef COMPUTED_GOTO
+// build the direct-threaded loop as execute()
+#define EXECUTE_NAME execute
+#define VM_THREADED
+#define VM_LOOP goto *dispatch[*pc++];
+#define VM_CASE(op) L_##op:
+#define VM_DEFAULT L_DEFAULT:
+#define VM_NEXT goto *dispatch[*pc++]
+#include "execute.h"
+#undef EXECUTE_NAME
+#undef VM_THREADED
+#undef VM_LOOP
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_NEXT
+#else
+// run a compiled program, leaving its results on the value stack
+int execute(program *prog, valueStack *stack) {
+	return executeSwitch(prog, stack);
+}
+#endif
+
+#endif
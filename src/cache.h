@@ -0,0 +1,198 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "eval.h"
+
+// define the default number of compiled expressions kept by a cache
+#define DEF_CACHE_CAPACITY 64
+
+// compiled expression kept by the cache
+typedef struct cacheEntry {
+	char *text;			// copy of the expression, the program references it
+	unsigned long hash; // hash of the expression
+	program prog;		// compiled expression
+	int prev;			// more recently used entry, or -1
+	int next;			// less recently used entry, or -1
+	int chain;			// next entry in the same hash bucket, or -1
+} cacheEntry;
+
+// bounded LRU cache of compiled expressions, keyed by their text
+typedef struct compileCache {
+	cacheEntry *entries;
+	int *buckets;		// first entry of each hash bucket, or -1
+	int bucketMask;		// number of buckets minus one, the number of buckets is a power of two
+	int capacity;		// maximum number of entries
+	int count;			// number of entries in use
+	int head;			// most recently used entry, or -1
+	int tail;			// least recently used entry, or -1
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} compileCache;
+
+// return the FNV-1a hash of an expression
+unsigned long hashText(char *text) {
+	unsigned long hash = 2166136261UL;
+	while (*text) {
+		hash = (hash ^ (unsigned char)*text++) * 16777619UL;
+	}
+	return hash;
+}
+
+// initialize a cache holding up to capacity compiled expressions
+int initCache(compileCache *cache, int capacity) {
+	int buckets = 1;
+	int i;
+	if (capacity < 1) {
+		capacity = DEF_CACHE_CAPACITY;
+	}
+	// keep the buckets at least twice the capacity, so the chains stay short
+	while (buckets < capacity * 2) {
+		buckets *= 2;
+	}
+	cache->entries = (cacheEntry *)malloc(capacity * sizeof(cacheEntry));
+	cache->buckets = (int *)malloc(buckets * sizeof(int));
+	if (cache->entries == NULL || cache->buckets == NULL) {
+		free(cache->entries);
+		free(cache->buckets);
+		return ERROR_OUT_OF_MEMORY;
+	}
+	for (i = 0; i < buckets; i++) {
+		cache->buckets[i] = -1;
+	}
+	cache->bucketMask = buckets - 1;
+	cache->capacity	  = capacity;
+	cache->count	  = 0;
+	cache->head		  = -1;
+	cache->tail		  = -1;
+	cache->hits		  = 0;
+	cache->misses	  = 0;
+	cache->evictions  = 0;
+	return ERROR_NONE;
+}
+
+// free the memory of a cache and all its compiled expressions
+void freeCache(compileCache *cache) {
+	int i;
+	for (i = 0; i < cache->count; i++) {
+		freeProgram(&cache->entries[i].prog);
+		free(cache->entries[i].text);
+	}
+	free(cache->entries);
+	free(cache->buckets);
+	cache->entries = NULL;
+	cache->buckets = NULL;
+	cache->count   = 0;
+}
+
+// unlink an entry from the LRU list
+void unlinkEntry(compileCache *cache, int i) {
+	cacheEntry *entry = &cache->entries[i];
+	if (entry->prev != -1) {
+		cache->entries[entry->prev].next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+	if (entry->next != -1) {
+		cache->entries[entry->next].prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+}
+
+// link an entry at the front of the LRU list
+void linkEntry(compileCache *cache, int i) {
+	cacheEntry *entry = &cache->entries[i];
+	entry->prev		  = -1;
+	entry->next		  = cache->head;
+	if (cache->head != -1) {
+		cache->entries[cache->head].prev = i;
+	} else {
+		cache->tail = i;
+	}
+	cache->head = i;
+}
+
+// remove the least recently used entry from its hash bucket and return it
+int evictEntry(compileCache *cache) {
+	int i	  = cache->tail;
+	int *link = &cache->buckets[cache->entries[i].hash & cache->bucketMask];
+	while (*link != i) {
+		link = &cache->entries[*link].chain;
+	}
+	*link = cache->entries[i].chain;
+	unlinkEntry(cache, i);
+	freeProgram(&cache->entries[i].prog);
+	free(cache->entries[i].text);
+	cache->evictions++;
+	return i;
+}
+
+// return the compiled form of the expression of a lexer context, compiling it on a miss
+// the program belongs to the cache and stays valid until it is evicted
+int cacheCompile(compileCache *cache, lexContext *ctx, program **prog) {
+	unsigned long hash = hashText(ctx->expr);
+	int *bucket		   = &cache->buckets[hash & cache->bucketMask];
+	cacheEntry *entry;
+	char *text;
+	program compiled;
+	arena *pool;
+	int error;
+	int i;
+
+	// look for the expression, comparing the whole text when the hashes match
+	for (i = *bucket; i != -1; i = cache->entries[i].chain) {
+		entry = &cache->entries[i];
+		if (entry->hash == hash && strcmp(entry->text, ctx->expr) == 0) {
+			unlinkEntry(cache, i);
+			linkEntry(cache, i);
+			cache->hits++;
+			*prog = &entry->prog;
+			return ERROR_NONE;
+		}
+	}
+
+	// compile the expression on the heap, since it outlives any arena, errors are not cached
+	cache->misses++;
+	pool	  = ctx->pool;
+	ctx->pool = NULL;
+	if ((error = parseExpr(ctx, &compiled)) == ERROR_NONE && (error = optimizeProgram(&compiled)) != ERROR_NONE) {
+		freeProgram(&compiled);
+	}
+	ctx->pool = pool;
+	if (error != ERROR_NONE) {
+		return error;
+	}
+	if ((text = (char *)malloc(strlen(ctx->expr) + 1)) == NULL) {
+		freeProgram(&compiled);
+		return ERROR_OUT_OF_MEMORY;
+	}
+	strcpy(text, ctx->expr);
+	// the program references the text of the expression, so point it at the copy owned by the cache
+	compiled.expr = text;
+
+	// take a free entry, or evict the least recently used one
+	i	  = cache->count < cache->capacity ? cache->count++ : evictEntry(cache);
+	entry = &cache->entries[i];
+	entry->text	 = text;
+	entry->hash	 = hash;
+	entry->prog	 = compiled;
+	entry->chain = *bucket;
+	*bucket		 = i;
+	linkEntry(cache, i);
+	*prog = &entry->prog;
+	return ERROR_NONE;
+}
+
+// function to evaluate an expression through a compile cache
+int evalCached(compileCache *cache, lexContext *ctx, valueStack *stack) {
+	program *prog;
+	int error;
+
+	if ((error = cacheCompile(cache, ctx, &prog)) != ERROR_NONE) {
+		return error;
+	}
+	return execute(prog, stack);
+}
+
+#endif
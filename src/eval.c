@@ -5,6 +5,78 @@
 #include "token.h"
 #include "postfix.h"
 #include "eval.h"
+#include "cache.h"
+
+// define the capacity of the demo compile cache, smaller than the number of expressions so it has to evict
+#define DEMO_CACHE_CAPACITY 4
+
+// define the number of times the expressions go through the compile cache
+#define DEMO_CACHE_ROUNDS 3
+
+// return 1 if two value stacks hold different results
+int differentResults(valueStack *a, valueStack *b) {
+	char ta[MAX_TOKEN_LENGTH], tb[MAX_TOKEN_LENGTH];
+	int j;
+	if (a->count != b->count) {
+		return 1;
+	}
+	for (j = 0; j < a->count; j++) {
+		formatValue(&a->items[j], ta);
+		formatValue(&b->items[j], tb);
+		if (strcmp(ta, tb) != 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// evaluate the expressions through a compile cache, comparing each compiled form and result with a cold compile
+// each expression is looked up twice in a row, a miss then a hit, and the small cache evicts it before the next round
+// the program the cache returns is used before the next lookup only, since evicting it frees it
+// return the number of differences
+int checkCache(char **exprs, int count) {
+	compileCache cache;
+	lexContext ctx;
+	valueStack cold, cached;
+	program fresh;
+	program *prog;
+	int coldError, error;
+	int round, i, lookup;
+	int mismatches = 0;
+
+	if (initCache(&cache, DEMO_CACHE_CAPACITY) != ERROR_NONE) {
+		return 1;
+	}
+	for (round = 0; round < DEMO_CACHE_ROUNDS; round++) {
+		for (i = 0; i < count; i++) {
+			// evaluate the expression cold
+			initContext(&ctx, exprs[i]);
+			initValueStack(&cold);
+			coldError = eval(&ctx, &cold);
+			for (lookup = 0; lookup < 2; lookup++) {
+				initContext(&ctx, exprs[i]);
+				initValueStack(&cached);
+				if ((error = cacheCompile(&cache, &ctx, &prog)) == ERROR_NONE) {
+					// the cached program must be the one a cold compile produces
+					initContext(&ctx, exprs[i]);
+					if (parseExpr(&ctx, &fresh) == ERROR_NONE) {
+						if (optimizeProgram(&fresh) != ERROR_NONE || fresh.size != prog->size || memcmp(fresh.code, prog->code, fresh.size) != 0) {
+							mismatches++;
+						}
+						freeProgram(&fresh);
+					}
+					error = execute(prog, &cached);
+				}
+				if (error != coldError || differentResults(&cold, &cached)) {
+					mismatches++;
+				}
+			}
+		}
+	}
+	printf("cache: capacity %d, %lu hits, %lu misses, %lu evictions, %d mismatches with cold compiles\n", cache.capacity, cache.hits, cache.misses, cache.evictions, mismatches);
+	freeCache(&cache);
+	return mismatches;
+}
 
 // main program
 // evaluate each expression and print the result
@@ -35,39 +107,50 @@ int main(int argc, char *argv[]) {
     };
 
 	// local variables
-	int i;
+	int i, j;
 	int error;
+	int removed;
+	char token[MAX_TOKEN_LENGTH];
+
+	// create a lexer context
+	lexContext ctx;
+
+	// create an arena for the memory used by each evaluation
+	arena pool;
 
-	// create a linked list for result tokens
-	tokenStack *tokens = NULL;
+	// create a value stack for the results
+	valueStack results;
 
 	// evaluate the expressions
+	initArena(&pool);
 	for (i = 0; i < sizeof(exprs) / sizeof(char *); i++) {
-		pExpr  = 0;
-		pType  = TOKEN_END;
-		pLevel = 0;
-		bLevel = 0;
+		initContext(&ctx, exprs[i]);
+		ctx.pool = &pool;
+		initValueStack(&results);
 		printf("%s = ", exprs[i]);
-		error = eval(exprs[i], &tokens);
+		error = evalCounting(&ctx, &results, &removed);
 		if (error != ERROR_NONE) {
-			printf("Error: %s at %d\n", errorMessages[error], pExpr);
-			for (int j = 0; j < pExpr; j++) {
+			printf("Error: %s at %d\n", errorMessages[error], ctx.pExpr);
+			for (j = 0; j < ctx.pExpr; j++) {
 				printf(" ");
 			}
 			printf("^\n");
 		} else {
 			printf("[");
-			while (tokens != NULL) {
-				printf("%s", tokens->token);
-				tokens = tokens->next;
-				if (tokens != NULL) {
+			for (j = results.count - 1; j >= 0; j--) {
+				formatValue(&results.items[j], token);
+				printf("%s", token);
+				if (j > 0) {
 					printf(" ");
 				}
 			}
-			printf("]\n");
+			printf("], %d instructions removed\n", removed);
 		}
 	}
-	return 0;
+	freeArena(&pool);
+
+	// evaluate them again through a compile cache
+	return checkCache(exprs, sizeof(exprs) / sizeof(char *)) != 0;
 }
 
 // q: how much is 2+3*4^5?
@@ -0,0 +1,137 @@
+// bytecode loop, included by bytecode.h once for each dispatch
+// the includer names the function with EXECUTE_NAME and defines the VM_ macros, and VM_THREADED for the jump table
+
+// run a compiled program, leaving its results on the value stack
+int EXECUTE_NAME(program *prog, valueStack *stack) {
+	unsigned char *pc = prog->code;
+	value *top;
+	int offset;
+	int error = ERROR_NONE;
+#ifdef VM_THREADED
+	// jump table indexed by opcode, bytes which are not opcodes go to the default label
+	// the opcode entries override the default range on purpose
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+	static void *dispatch[256] = {[0 ... 255] = &&L_DEFAULT,
+								  [OP_END] = &&L_OP_END,
+								  [OP_INT] = &&L_OP_INT,
+								  [OP_FLOAT] = &&L_OP_FLOAT,
+								  [OP_STRING] = &&L_OP_STRING,
+								  [OP_VARIABLE] = &&L_OP_VARIABLE,
+								  [OP_NEG] = &&L_OP_NEG,
+								  [OP_POS] = &&L_OP_POS,
+								  [OP_ADD] = &&L_OP_ADD,
+								  [OP_SUB] = &&L_OP_SUB,
+								  [OP_MUL] = &&L_OP_MUL,
+								  [OP_DIV] = &&L_OP_DIV,
+								  [OP_POW] = &&L_OP_POW,
+								  [OP_MOD] = &&L_OP_MOD};
+#pragma GCC diagnostic pop
+#endif
+
+	// the stack depth was computed by the compiler, so the capacity is only checked once
+	if (stack->count + prog->depth > MAX_VALUE_STACK) {
+		return ERROR_STACK_OVERFLOW;
+	}
+	top = stack->items + stack->count - 1;
+
+	VM_LOOP {
+		VM_CASE(OP_END)
+			goto done;
+		VM_CASE(OP_INT)
+			top++;
+			top->type = VALUE_INT;
+			memcpy(&top->as.integer, pc, sizeof(long));
+			pc += sizeof(long);
+			VM_NEXT;
+		VM_CASE(OP_FLOAT)
+			top++;
+			top->type = VALUE_FLOAT;
+			memcpy(&top->as.real, pc, sizeof(double));
+			pc += sizeof(double);
+			VM_NEXT;
+		VM_CASE(OP_STRING)
+			top++;
+			top->type = VALUE_STRING;
+			memcpy(&offset, pc, sizeof(int));
+			memcpy(&top->as.string.length, pc + sizeof(int), sizeof(int));
+			top->as.string.text = prog->expr + offset;
+			pc += 2 * sizeof(int);
+			VM_NEXT;
+		VM_CASE(OP_VARIABLE)
+			// variables are not bound to the evaluator
+			error = ERROR_INVALID_VARIABLE;
+			goto done;
+		VM_CASE(OP_NEG)
+			if (!isNumeric(top)) {
+				goto mismatch;
+			}
+			top->as.real = -valueNumber(top);
+			top->type	 = VALUE_FLOAT;
+			VM_NEXT;
+		VM_CASE(OP_POS)
+			if (!isNumeric(top)) {
+				goto mismatch;
+			}
+			top->as.real = valueNumber(top);
+			top->type	 = VALUE_FLOAT;
+			VM_NEXT;
+		VM_CASE(OP_ADD)
+			if (!numericPair(top)) {
+				goto mismatch;
+			}
+			top[-1].as.real = valueNumber(top - 1) + valueNumber(top);
+			top[-1].type	= VALUE_FLOAT;
+			top--;
+			VM_NEXT;
+		VM_CASE(OP_SUB)
+			if (!numericPair(top)) {
+				goto mismatch;
+			}
+			top[-1].as.real = valueNumber(top - 1) - valueNumber(top);
+			top[-1].type	= VALUE_FLOAT;
+			top--;
+			VM_NEXT;
+		VM_CASE(OP_MUL)
+			if (!numericPair(top)) {
+				goto mismatch;
+			}
+			top[-1].as.real = valueNumber(top - 1) * valueNumber(top);
+			top[-1].type	= VALUE_FLOAT;
+			top--;
+			VM_NEXT;
+		VM_CASE(OP_DIV)
+			if (!numericPair(top)) {
+				goto mismatch;
+			}
+			top[-1].as.real = valueNumber(top - 1) / valueNumber(top);
+			top[-1].type	= VALUE_FLOAT;
+			top--;
+			VM_NEXT;
+		VM_CASE(OP_POW)
+			if (!numericPair(top)) {
+				goto mismatch;
+			}
+			top[-1].as.real = pow(valueNumber(top - 1), valueNumber(top));
+			top[-1].type	= VALUE_FLOAT;
+			top--;
+			VM_NEXT;
+		VM_CASE(OP_MOD)
+			if (!numericPair(top)) {
+				goto mismatch;
+			}
+			top[-1].as.real = fmod(valueNumber(top - 1), valueNumber(top));
+			top[-1].type	= VALUE_FLOAT;
+			top--;
+			VM_NEXT;
+		VM_DEFAULT
+			error = ERROR_UNKNOWN_OPERATOR;
+			goto done;
+	}
+
+mismatch:
+	error = ERROR_TYPE_MISMATCH;
+done:
+	stack->count = top - stack->items + 1;
+	return error;
+}
@@ -0,0 +1,206 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "mvcc.h"
+
+// default number of reader threads and of versions the writer publishes
+#define DEF_READERS 4
+#define DEF_PUBLISHES 20000
+
+// partition size of the test, large enough to span several pages
+#define MVCC_PARTITION_SIZE 32000
+
+// number of variable names the writer changes, and of changes between two publishes at most
+#define MVCC_NAMES 300
+#define MVCC_CHANGES 8
+
+// number of variables the writer sets to the publish number before each publish
+#define MVCC_BATCH 4
+
+// longest string value of a variable
+#define MVCC_STRING 40
+
+// number of publishes between two compactions of the partition
+#define MVCC_COMPACT 100
+
+// number of variables a reader looks up in each version it acquires
+#define MVCC_LOOKUPS 16
+
+// set when the writer is done, to stop the readers
+static atomic_bool stop;
+
+// function to get the name of a variable the writer changes
+static char *var_name(char *name, int k) {
+    sprintf(name, "v%d", k);
+    return name;
+}
+
+// function to get the name of a batch variable
+static char *batch_name(char *name, int b) {
+    sprintf(name, "b%d", b);
+    return name;
+}
+
+// function to build the string value of a variable from its number and length
+static char *var_string(char *value, int k, int length) {
+    for (int i = 0; i < length; i++) {
+        value[i] = 'a' + (k + i) % 26;
+    }
+    value[length] = '\0';
+    return value;
+}
+
+// function to check a variable holds a value the writer makes for its number, returns false if it doesn't
+// integers are the number plus a multiple of MVCC_NAMES, strings come from var_string
+static bool check_var(char *vBuf, int k) {
+    char value[MVCC_STRING + 1];
+    if (get_var_type(vBuf) == 0x03) {
+        return get_var_int(vBuf) % MVCC_NAMES == k;
+    }
+    char *z = get_var_zstr(vBuf);
+    uint8_t length = z[0];
+    return get_var_type(vBuf) == 0x05 && length <= MVCC_STRING && memcmp(z + 1, var_string(value, k, length), length) == 0;
+}
+
+// function to check an image holds the same bytes as a memory area
+static bool same_image(mvcc_image *image, char *area, size_t size) {
+    if (image->size != size) {
+        return false;
+    }
+    for (size_t i = 0; i < image->count; i++) {
+        size_t n = size - i * MVCC_PAGE_SIZE < MVCC_PAGE_SIZE ? size - i * MVCC_PAGE_SIZE : MVCC_PAGE_SIZE;
+        if (memcmp(image->pages[i]->data, area + i * MVCC_PAGE_SIZE, n) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// reader thread body, acquires versions until the writer is done and checks what they hold
+// the batch variables of a version must all hold the same publish number, which never goes back, and the other
+// variables must hold values the writer makes for them
+// returns the number of failed checks
+static void *reader(void *arg) {
+    int slot = (int)(long)arg;
+    unsigned long seed = slot + 1;
+    long mismatches = 0;
+    int last = 0;
+    char name[16];
+    char vBuf[3 + 255 + 255];
+
+    while (!atomic_load(&stop)) {
+        mvcc_version *v = mvcc_acquire(slot);
+        int published = -1;
+        for (int b = 0; b < MVCC_BATCH; b++) {
+            if (!mvcc_find_var(v, batch_name(name, b), vBuf)) {
+                mismatches++;
+            } else if (b == 0) {
+                published = get_var_int(vBuf);
+            } else if (get_var_int(vBuf) != published) {
+                mismatches++;
+            }
+        }
+        if (published < last) {
+            mismatches++;
+        }
+        last = published;
+        for (int i = 0; i < MVCC_LOOKUPS; i++) {
+            seed = seed * 1103515245 + 12345;
+            int k = (seed >> 16) % MVCC_NAMES;
+            if (mvcc_find_var(v, var_name(name, k), vBuf) && !check_var(vBuf, k)) {
+                mismatches++;
+            }
+        }
+        mvcc_release(slot);
+    }
+    return (void *)mismatches;
+}
+
+// function to set the batch variables to the publish number and publish the partition
+// the published version must hold the same bytes as the partition, returns false if it doesn't or can't be published
+static bool publish(int published) {
+    char name[16];
+    for (int b = 0; b < MVCC_BATCH; b++) {
+        if (update_int_var(batch_name(name, b), published) != 0) {
+            return false;
+        }
+    }
+    if (!mvcc_publish()) {
+        return false;
+    }
+    mvcc_version *v = atomic_load(&mvccCurrent);
+    return same_image(&v->partition, pStart, pSize) && same_image(&v->index, (char *)vIndex, iSize * sizeof(psize_t))
+        && v->used == (psize_t)(pEnd - pStart);
+}
+
+// main program
+// publish versions of a changing partition while reader threads check them, returns 1 if any check failed
+int main(int argc, char *argv[]) {
+    int readers = argc > 1 ? atoi(argv[1]) : DEF_READERS;
+    int publishes = argc > 2 ? atoi(argv[2]) : DEF_PUBLISHES;
+    long mismatches = 0;
+    char name[16];
+    char value[MVCC_STRING + 1];
+    pthread_t ids[MVCC_MAX_READERS];
+    void *result;
+
+    if (readers < 1 || readers > MVCC_MAX_READERS || publishes < 1) {
+        printf("Usage: mvcc [readers] [publishes], with 1 to %d readers\n", MVCC_MAX_READERS);
+        return 1;
+    }
+    patch[6] = MVCC_PARTITION_SIZE % 256;
+    patch[7] = MVCC_PARTITION_SIZE / 256;
+    alloc_partition();
+    init_partition();
+    if (!publish(0)) {
+        printf("Error: could not publish the partition\n");
+        return 1;
+    }
+    for (int i = 0; i < readers; i++) {
+        if (pthread_create(&ids[i], NULL, reader, (void *)(long)i) != 0) {
+            printf("Error: could not start reader %d\n", i);
+            return 1;
+        }
+    }
+
+    // change random variables between the publishes, compacting now and then so whole pages change
+    for (int published = 1; published <= publishes; published++) {
+        int changes = 1 + rand() % MVCC_CHANGES;
+        for (int c = 0; c < changes; c++) {
+            int k = rand() % MVCC_NAMES;
+            var_name(name, k);
+            switch (rand() % 3) {
+            case 0:
+                update_int_var(name, k + MVCC_NAMES * published);
+                break;
+            case 1:
+                update_string_var(name, var_string(value, k, rand() % (MVCC_STRING + 1)));
+                break;
+            default:
+                delete_var(name);
+            }
+        }
+        if (published % MVCC_COMPACT == 0) {
+            compact_partition(pStart);
+        }
+        if (!publish(published)) {
+            printf("Error: version %d doesn't match the partition\n", published);
+            mismatches++;
+        }
+    }
+
+    atomic_store(&stop, true);
+    for (int i = 0; i < readers; i++) {
+        pthread_join(ids[i], &result);
+        mismatches += (long)result;
+    }
+    printf("%d readers, %d publishes, %lu compactions, %ld mismatches\n", readers, publishes, compactions, mismatches);
+    mvcc_free();
+    free_partition();
+    return mismatches != 0;
+}
@@ -0,0 +1,283 @@
+#ifndef MVCC_H
+#define MVCC_H
+
+// Copy-on-write versions of the partition for concurrent readers.
+//
+// A single writer changes the partition with add_var/update_var/delete_var as usual and calls mvcc_publish to make the
+// changes visible. Publishing builds a new immutable version of the partition and the index, split in pages:
+// the partition functions report the bytes they change through the dirty hook, which marks their pages in a
+// bitmap, so publishing copies the marked pages and shares the others with the previous version.
+//
+// Readers never lock. A reader takes a slot, acquires the current version, reads from it and releases it:
+//      mvcc_version *v = mvcc_acquire(slot);
+//      if (mvcc_find_var(v, "myInt", vBuf)) ...
+//      mvcc_release(slot);
+//
+// Versions replaced by a newer one are retired and freed once no reader can still hold them (epoch based
+// reclamation): each acquire records the global epoch in the reader slot, each publish advances the epoch, and
+// a version retired at epoch e is freed when every busy slot has recorded an epoch after e.
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "orb.h"
+
+//---------- constants ----------
+
+#define MVCC_PAGE_SIZE 4096
+#define MVCC_MAX_READERS 64
+
+//---------- custom types ----------
+
+// page of a version, shared by all the versions it's unchanged in
+typedef struct mvcc_page {
+    unsigned int refs;              // number of versions using the page, only touched by the writer
+    char data[MVCC_PAGE_SIZE];
+} mvcc_page;
+
+// memory area split in pages
+typedef struct mvcc_image {
+    size_t size;                    // size of the area
+    size_t count;                   // number of pages
+    mvcc_page **pages;
+} mvcc_image;
+
+// immutable version of the partition and the index
+typedef struct mvcc_version {
+    mvcc_image partition;
+    mvcc_image index;
+    psize_t used;                   // offset of the empty area at the end of the partition
+    psize_t iSize;                  // number of slots in the index
+    unsigned long retired;          // epoch the version was retired at
+    struct mvcc_version *next;      // next retired version
+} mvcc_version;
+
+//---------- global variables ----------
+
+static _Atomic(mvcc_version *) mvccCurrent;                 // version readers acquire
+static atomic_ulong mvccEpoch = 1;                          // global epoch, advanced by each publish
+static atomic_ulong mvccReaders[MVCC_MAX_READERS];          // epoch each reader slot acquired at, 0 if idle
+static mvcc_version *mvccRetired;                           // retired versions waiting to be freed
+static unsigned char *mvccDirty[2];                         // pages of the partition and the index changed since the last publish
+static size_t mvccDirtyPages[2];                            // number of pages each bitmap covers
+
+//---------- image functions ----------
+
+// function to build a paged image of a memory area, sharing the pages of the previous image which are not marked dirty
+// without a dirty bitmap every page is copied
+static inline bool image_build(mvcc_image *image, char *area, size_t size, mvcc_image *prev, unsigned char *dirty, size_t dirtyPages) {
+    image->size = size;
+    image->count = (size + MVCC_PAGE_SIZE - 1) / MVCC_PAGE_SIZE;
+    if ((image->pages = malloc(image->count * sizeof(mvcc_page *))) == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < image->count; i++) {
+        size_t n = size - i * MVCC_PAGE_SIZE < MVCC_PAGE_SIZE ? size - i * MVCC_PAGE_SIZE : MVCC_PAGE_SIZE;
+        char *p = area + i * MVCC_PAGE_SIZE;
+        mvcc_page *page = NULL;
+        // share the page of the previous image if it wasn't changed and holds as many bytes
+        if (prev != NULL && dirty != NULL && i < prev->count && i < dirtyPages && !(dirty[i / 8] & (1 << (i % 8)))
+            && prev->size >= i * MVCC_PAGE_SIZE + n) {
+            page = prev->pages[i];
+        } else if ((page = malloc(sizeof(mvcc_page))) != NULL) {
+            page->refs = 0;
+            memcpy(page->data, p, n);
+        } else {
+            // release the pages taken so far
+            while (i--) {
+                if (--image->pages[i]->refs == 0) {
+                    free(image->pages[i]);
+                }
+            }
+            free(image->pages);
+            return false;
+        }
+        page->refs++;
+        image->pages[i] = page;
+    }
+    return true;
+}
+
+// function to release the pages of an image
+static inline void image_free(mvcc_image *image) {
+    for (size_t i = 0; i < image->count; i++) {
+        if (--image->pages[i]->refs == 0) {
+            free(image->pages[i]);
+        }
+    }
+    free(image->pages);
+}
+
+// function to copy bytes out of an image, returns false if they are out of bounds
+static inline bool image_read(mvcc_image *image, size_t offset, void *dst, size_t size) {
+    char *d = dst;
+    if (offset > image->size || size > image->size - offset) {
+        return false;
+    }
+    while (size > 0) {
+        size_t in = offset % MVCC_PAGE_SIZE;
+        size_t n = MVCC_PAGE_SIZE - in < size ? MVCC_PAGE_SIZE - in : size;
+        memcpy(d, image->pages[offset / MVCC_PAGE_SIZE]->data + in, n);
+        d += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+//---------- dirty page functions ----------
+
+// function to mark the pages of the partition or the index the writer changed, called through the dirty hook
+// pages past the bitmap are new since the last publish and always copied
+static inline void mvcc_mark(bool index, size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    size_t last = (offset + size - 1) / MVCC_PAGE_SIZE;
+    for (size_t i = offset / MVCC_PAGE_SIZE; i <= last && i < mvccDirtyPages[index]; i++) {
+        mvccDirty[index][i / 8] |= 1 << (i % 8);
+    }
+}
+
+// function to start tracking the changes to an image from a clear bitmap, which is dropped if it can't be allocated
+static inline void mvcc_track(mvcc_image *image, int which) {
+    unsigned char *map = realloc(mvccDirty[which], (image->count + 7) / 8);
+    if (map == NULL) {
+        free(mvccDirty[which]);
+        mvccDirty[which] = NULL;
+        mvccDirtyPages[which] = 0;
+        return;
+    }
+    memset(map, 0, (image->count + 7) / 8);
+    mvccDirty[which] = map;
+    mvccDirtyPages[which] = image->count;
+}
+
+//---------- version functions ----------
+
+// function to free a version
+static inline void version_free(mvcc_version *v) {
+    image_free(&v->partition);
+    image_free(&v->index);
+    free(v);
+}
+
+// function to free the retired versions no reader can hold anymore
+static inline void mvcc_reclaim(void) {
+    // find the oldest epoch a busy reader acquired at
+    unsigned long oldest = atomic_load(&mvccEpoch);
+    for (int i = 0; i < MVCC_MAX_READERS; i++) {
+        unsigned long e = atomic_load(&mvccReaders[i]);
+        if (e != 0 && e < oldest) {
+            oldest = e;
+        }
+    }
+    // versions retired before that epoch are unreachable
+    mvcc_version **link = &mvccRetired;
+    while (*link != NULL) {
+        mvcc_version *v = *link;
+        if (v->retired < oldest) {
+            *link = v->next;
+            version_free(v);
+        } else {
+            link = &v->next;
+        }
+    }
+}
+
+// function to publish the current partition as a new version, returns false if out of memory
+// only the writer calls it, between changes to the partition
+static inline bool mvcc_publish(void) {
+    mvcc_version *prev = atomic_load(&mvccCurrent);
+    mvcc_version *v = malloc(sizeof(mvcc_version));
+    if (v == NULL) {
+        return false;
+    }
+    // copy the changed pages of the partition and the index
+    if (!image_build(&v->partition, pStart, pSize, prev != NULL ? &prev->partition : NULL, mvccDirty[0], mvccDirtyPages[0])) {
+        free(v);
+        return false;
+    }
+    if (!image_build(&v->index, (char *)vIndex, iSize * sizeof(psize_t), prev != NULL ? &prev->index : NULL, mvccDirty[1], mvccDirtyPages[1])) {
+        image_free(&v->partition);
+        free(v);
+        return false;
+    }
+    // track the changes made from now on against the new version
+    mvcc_track(&v->partition, 0);
+    mvcc_track(&v->index, 1);
+    set_dirty_hook(mvcc_mark);
+    v->used = pEnd - pStart;
+    v->iSize = iSize;
+    v->next = NULL;
+
+    // install the version, then retire the previous one at the epoch readers could have acquired it in
+    atomic_store(&mvccCurrent, v);
+    if (prev != NULL) {
+        prev->retired = atomic_fetch_add(&mvccEpoch, 1);
+        prev->next = mvccRetired;
+        mvccRetired = prev;
+    }
+    mvcc_reclaim();
+    return true;
+}
+
+// function to acquire the current version in a reader slot, returns NULL if nothing was published
+// each reader thread uses its own slot, from 0 to MVCC_MAX_READERS - 1
+static inline mvcc_version *mvcc_acquire(int slot) {
+    atomic_store(&mvccReaders[slot], atomic_load(&mvccEpoch));
+    return atomic_load(&mvccCurrent);
+}
+
+// function to release the version acquired in a reader slot
+static inline void mvcc_release(int slot) {
+    atomic_store(&mvccReaders[slot], 0);
+}
+
+// function to free all the versions, when there are no readers left
+static inline void mvcc_free(void) {
+    set_dirty_hook(NULL);
+    for (int i = 0; i < 2; i++) {
+        free(mvccDirty[i]);
+        mvccDirty[i] = NULL;
+        mvccDirtyPages[i] = 0;
+    }
+    mvcc_version *v = atomic_exchange(&mvccCurrent, NULL);
+    if (v != NULL) {
+        version_free(v);
+    }
+    while ((v = mvccRetired) != NULL) {
+        mvccRetired = v->next;
+        version_free(v);
+    }
+}
+
+//---------- reader functions ----------
+
+// function to find a variable in a version and copy it into a variable buffer, returns false if not found
+static inline bool mvcc_find_var(mvcc_version *v, char *name, char *vBuf) {
+    uint8_t size = strlen(name);
+    psize_t i = name_hash(name, size) & (v->iSize - 1);
+    psize_t slot;
+    char var[2];
+
+    // probe the index of the version like find_slot does
+    while (image_read(&v->index, i * sizeof(psize_t), &slot, sizeof(slot)) && slot != INDEX_EMPTY) {
+        if (slot != INDEX_DELETED) {
+            // read the variable type and name size, then the name and value
+            size_t offset = slot - 1 + ELEMENT_HEADER_SIZE;
+            if (image_read(&v->partition, offset, var, 2) && (uint8_t)var[1] == size
+                && image_read(&v->partition, offset, vBuf, size + 3) && memcmp(vBuf + 2, name, size) == 0) {
+                return image_read(&v->partition, offset, vBuf, get_var_size(vBuf));
+            }
+        }
+        i = (i + 1) & (v->iSize - 1);
+    }
+    return false;
+}
+
+#endif
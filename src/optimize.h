@@ -0,0 +1,176 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <math.h>
+#include "bytecode.h"
+
+// enumerate what the optimizer knows about a value on the stack
+enum foldKinds {
+	FOLD_OTHER, // string, variable or anything else only known when running
+	FOLD_FLOAT, // result of an arithmetic instruction, always a float when it exists
+	FOLD_CONST	// number constant
+};
+
+// value on the stack of the optimizer
+typedef struct foldEntry {
+	int kind;		// what is known about the value
+	int start;		// offset of the code producing the value in the optimized program
+	double number;	// value of constants
+} foldEntry;
+
+// read the value of a number constant instruction
+double constantValue(unsigned char *pc) {
+	long integer;
+	double real;
+	if (*pc == OP_INT) {
+		memcpy(&integer, pc + 1, sizeof(long));
+		return (double)integer;
+	}
+	memcpy(&real, pc + 1, sizeof(double));
+	return real;
+}
+
+// replace the code from the given offset to the end of the program with a float constant
+int emitFolded(program *prog, int start, double number) {
+	int error;
+	prog->size = start;
+	if ((error = emitOp(prog, OP_FLOAT)) != ERROR_NONE) {
+		return error;
+	}
+	return emitBytes(prog, &number, sizeof(double));
+}
+
+// compute an instruction over constants, the same way execute() does
+double foldInstruction(unsigned char op, double op1, double op2) {
+	switch (op) {
+	case OP_NEG:
+		return -op2;
+	case OP_POS:
+		return op2;
+	case OP_ADD:
+		return op1 + op2;
+	case OP_SUB:
+		return op1 - op2;
+	case OP_MUL:
+		return op1 * op2;
+	case OP_DIV:
+		return op1 / op2;
+	case OP_POW:
+		return pow(op1, op2);
+	default:
+		return fmod(op1, op2);
+	}
+}
+
+// return true if applying the instruction to x and the constant c always gives back x
+// the identities only hold for floats, x + 0 is not one of them because -0 + 0 is +0
+int isIdentity(unsigned char op, double c, int constantFirst) {
+	switch (op) {
+	case OP_MUL:
+		return c == 1;
+	case OP_ADD:
+		return c == 0 && signbit(c);
+	case OP_SUB:
+	case OP_DIV:
+	case OP_POW:
+		return !constantFirst && c == (op == OP_SUB ? 0 : 1);
+	default:
+		return 0;
+	}
+}
+
+// fold constant subexpressions and remove identity operations from a program
+// the program is rewritten in place and the number of instructions removed is stored in prog->removed
+int optimizeProgram(program *prog) {
+	foldEntry stack[MAX_VALUE_STACK];
+	foldEntry *a, *b;
+	program out;
+	unsigned char *pc;
+	unsigned char op;
+	int count  = 0;
+	int before = 0;
+	int after  = 0;
+	int error  = ERROR_NONE;
+	int size;
+
+	// programs which don't fit the value stack fail when running, leave them alone
+	if (prog->depth > MAX_VALUE_STACK) {
+		return ERROR_NONE;
+	}
+
+	initProgram(&out, prog->expr);
+	out.pool = prog->pool;
+	for (pc = prog->code; error == ERROR_NONE; pc += size) {
+		op	 = *pc;
+		size = instructionSize(op);
+		before++;
+		if (op == OP_END) {
+			error = emitOp(&out, op);
+			break;
+		}
+		switch (op) {
+		case OP_INT:
+		case OP_FLOAT:
+		case OP_STRING:
+		case OP_VARIABLE:
+			a		 = &stack[count++];
+			a->kind	 = op == OP_INT || op == OP_FLOAT ? FOLD_CONST : FOLD_OTHER;
+			a->start = out.size;
+			if (a->kind == FOLD_CONST) {
+				a->number = constantValue(pc);
+			}
+			error = emitBytes(&out, pc, size);
+			break;
+		case OP_NEG:
+		case OP_POS:
+			b = &stack[count - 1];
+			if (b->kind == FOLD_CONST) {
+				b->number = foldInstruction(op, 0, b->number);
+				error	  = emitFolded(&out, b->start, b->number);
+			} else if (op == OP_POS && b->kind == FOLD_FLOAT) {
+				// unary plus of a float is the float itself
+			} else {
+				b->kind = FOLD_FLOAT;
+				error	= emitOp(&out, op);
+			}
+			break;
+		default:
+			b = &stack[--count];
+			a = &stack[count - 1];
+			if (a->kind == FOLD_CONST && b->kind == FOLD_CONST) {
+				a->number = foldInstruction(op, a->number, b->number);
+				error	  = emitFolded(&out, a->start, a->number);
+			} else if (a->kind == FOLD_FLOAT && b->kind == FOLD_CONST && isIdentity(op, b->number, 0)) {
+				// drop the constant, leaving x
+				out.size = b->start;
+			} else if (a->kind == FOLD_CONST && b->kind == FOLD_FLOAT && isIdentity(op, a->number, 1)) {
+				// drop the constant, moving the code of x over it
+				memmove(out.code + a->start, out.code + b->start, out.size - b->start);
+				out.size -= b->start - a->start;
+				a->kind = FOLD_FLOAT;
+			} else {
+				a->kind = FOLD_FLOAT;
+				error	= emitOp(&out, op);
+			}
+			break;
+		}
+		if (count > out.depth) {
+			out.depth = count;
+		}
+	}
+	if (error != ERROR_NONE) {
+		freeProgram(&out);
+		return error;
+	}
+
+	// count the instructions left
+	for (pc = out.code; *pc != OP_END; pc += instructionSize(*pc)) {
+		after++;
+	}
+	out.removed = before - after - 1;
+	freeProgram(prog);
+	*prog = out;
+	return ERROR_NONE;
+}
+
+#endif
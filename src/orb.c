@@ -103,6 +103,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 #include "orb.h"
 
 // main program
@@ -120,7 +121,7 @@ int main(int argc, char *argv[]) {
     init_partition();
 
     // print the partition size
-    printf("Partition size: %d\n", pSize);
+    printf("Partition size: %lu\n", (unsigned long)pSize);
 
     // load a null variable into the variable buffer vBuf1 and add it to the partition
     load_null_var(vBuf1, "myNull");
@@ -153,9 +154,8 @@ int main(int argc, char *argv[]) {
     // delete the variable myInt
     delete_var("myInt");
 
-    // load an int variable into the variable buffer vBuf1 and add it to the partition
-    load_int_var(vBuf1, "myInt", 666);
-    add_var(vBuf1);
+    // add an int variable directly to the partition
+    emplace_int_var("myInt", 666);
 
     // delete the variable myInt
     delete_var("myInt");
@@ -167,9 +167,21 @@ int main(int argc, char *argv[]) {
     // print the contents of the partition
     printf("Partition contents:\n");
     list_elements(pStart);
+    print_fragmentation();
 
     // load an int variable into the variable buffer vBuf1 and add it to the partition
     load_int_var(vBuf1, "otherInt", 123);
     add_var(vBuf1);
 
+    // look up the variable myString and print it
+    char *v = find_var("myString");
+    if (v != NULL) {
+        print_var(v);
+    }
+
+    // set a shorter value for the variable myString, which is written in place
+    update_string_var("myString", "Hello!");
+    print_var(find_var("myString"));
+    print_fragmentation();
+
 }
@@ -5,6 +5,29 @@
 
 typedef unsigned short int uint16_t;
 typedef unsigned char uint8_t;
+typedef unsigned int uint32_t;
+
+// partition sizes and offsets, 32 bits wide in partitions built with WIDE_PARTITION, which also grow when full
+#ifdef WIDE_PARTITION
+typedef uint32_t psize_t;
+#else
+typedef uint16_t psize_t;
+#endif
+
+// POSIX systems map snapshots and can back partitions with mmap, elsewhere everything comes from malloc
+// strict ISO C builds, like -std=c99, hide anonymous mappings and take the malloc path as well
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(MAP_ANONYMOUS) || defined(MAP_ANON)
+#define HAVE_MMAP
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+#endif
 
 //---------- constants ----------
 
@@ -13,8 +36,65 @@ typedef unsigned char uint8_t;
 #define DEF_LABEL_NAME_SIZE 8
 #define DEF_VAR_BUF_SIZE 266
 
+// largest partition size
+#define MAX_PARTITION_SIZE ((psize_t)-1)
+
+// size of the element type and size fields
+#define ELEMENT_HEADER_SIZE (1 + sizeof(psize_t))
+
+// smallest variable element: element header, variable type, one character name and an empty value
+#define MIN_VAR_ELEMENT_SIZE (ELEMENT_HEADER_SIZE + 4)
+
+// smallest deleted block, which must hold the element header, the free list links and the size footer
+// smaller deleted elements are left out of the free lists until the element before them is deleted or the partition is compacted
+#define MIN_BLOCK_SIZE (ELEMENT_HEADER_SIZE + 3 * sizeof(psize_t))
+
+// flag in the type of a live element or the empty area whose previous element is a deleted block in the free lists
+// only the allocator sets it, so the size footer before the element is never read from the contents of a variable
+#define PREV_FREE 0x80
+
+// number of deleted block size classes, class n holds the blocks of 4 << n to (8 << n) - 1 bytes, class 0 stays empty
+#define FREE_CLASSES (sizeof(psize_t) * 8 - 2)
+
+// partition allocation backends, each one falls back to the next if it's not available
+#define BACKEND_HUGETLB 3   // anonymous mapping from the reserved huge pages
+#define BACKEND_HUGEPAGE 2  // anonymous mapping advised to use transparent huge pages
+#define BACKEND_MMAP 1      // anonymous mapping
+#define BACKEND_MALLOC 0    // heap
+
+// huge page size, the huge page backends round the partition up to it
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// snapshot file identification
+#define SNAPSHOT_MAGIC "ORBS"
+#define SNAPSHOT_VERSION 3
+
+// alignment of the partition and the index in a snapshot file
+#define SNAPSHOT_ALIGN 16
+
+// index slot markers, used slots store the element offset plus one
+#define INDEX_EMPTY 0
+#define INDEX_DELETED ((psize_t)-1)
+
+// number of slots of an empty index, the index doubles as variables are added
+#define MIN_INDEX_SLOTS 8
+
 #define DEBUG
 
+// the partition variables and buffers are per thread when THREAD_LOCAL_PARTITION is defined, so threads can work on different partitions
+#ifdef THREAD_LOCAL_PARTITION
+#define PARTITION_LOCAL _Thread_local
+#else
+#define PARTITION_LOCAL
+#endif
+
+// the buffers are there for the programs including the header, which don't all use every one of them
+#ifdef __GNUC__
+#define MAYBE_UNUSED __attribute__((unused))
+#else
+#define MAYBE_UNUSED
+#endif
+
 //---------- global variables ----------
 
 // Define a patch area which allows us to patch the code later
@@ -22,26 +102,157 @@ static char patch[] = {
     '[', 'P', 'A', 'T', 'C', 'H', DEF_PARTITION_SIZE % 256, DEF_PARTITION_SIZE / 256, ']'};
 
 // Define a couple variable buffers
-static char vBuf1[DEF_VAR_BUF_SIZE];
-static char vBuf2[DEF_VAR_BUF_SIZE];
+static PARTITION_LOCAL char vBuf1[DEF_VAR_BUF_SIZE] MAYBE_UNUSED;
+static PARTITION_LOCAL char vBuf2[DEF_VAR_BUF_SIZE] MAYBE_UNUSED;
 
 // Define a z-string buffer
-static char zBuf[256];
+static PARTITION_LOCAL char zBuf[256] MAYBE_UNUSED;
 
 // Define a c-string buffer
-static char cBuf[256];
+static PARTITION_LOCAL char cBuf[256] MAYBE_UNUSED;
 
-static uint16_t pSize;  // partition size
+static PARTITION_LOCAL psize_t pSize; // partition size
 
 //----------- partition pointer variables ----------
 
-static char *pStart;    // pointer to the start of the partition
-static char *pEnd;      // pointer to the end of the partition
+static PARTITION_LOCAL char *pStart;    // pointer to the start of the partition
+static PARTITION_LOCAL char *pEnd;      // pointer to the end of the partition
+static PARTITION_LOCAL char *pMap;      // snapshot mapping holding the partition and the index, or NULL if they are on the heap
+static PARTITION_LOCAL size_t pMapSize; // size of the snapshot mapping
+static PARTITION_LOCAL bool pShared;    // the mapping is a shared memory segment, which can't grow or be detached
+
+//----------- partition allocation variables ----------
+
+static uint8_t pBackend = BACKEND_MALLOC;     // backend requested for the partition
+static bool pPrefault;                        // touch every page of the partition when it's allocated
+static PARTITION_LOCAL uint8_t pAllocBackend; // backend the partition was allocated from
+static PARTITION_LOCAL size_t pAllocSize;     // allocated size of the partition, which can exceed the partition size
+
+//----------- variable index variables ----------
+
+static PARTITION_LOCAL psize_t *vIndex; // open addressing hash table of variable element offsets
+static PARTITION_LOCAL psize_t iSize;   // number of slots in the index, a power of two
+static PARTITION_LOCAL psize_t iUsed;   // number of slots holding an offset or a deleted marker
+
+//----------- free list variables ----------
+
+static PARTITION_LOCAL psize_t freeList[FREE_CLASSES]; // first deleted block of each size class, as its offset plus one or 0 if none
+static PARTITION_LOCAL psize_t slackBytes;             // bytes the variable elements leave unused after a split or an update
+
+//----------- compaction variables ----------
+
+// function called when compaction moves an element, with the old and new offsets of the element
+typedef void (*relocate_fn)(psize_t from, psize_t to);
+
+static PARTITION_LOCAL relocate_fn relocateHook;   // relocation callback for references held outside the partition, or NULL
+static PARTITION_LOCAL unsigned long coalesces;    // number of deleted blocks merged with a neighbour on delete
+static PARTITION_LOCAL unsigned long compactions;  // number of times the partition was compacted
+static PARTITION_LOCAL unsigned long compactBytes; // bytes moved by compaction
+static PARTITION_LOCAL double compactSeconds;      // processor time spent compacting
+
+//----------- change tracking variables ----------
+
+// function called when the partition or the index changes, with the offset and size of the changed bytes in either of them
+typedef void (*dirty_fn)(bool index, size_t offset, size_t size);
+
+static PARTITION_LOCAL dirty_fn dirtyHook;         // change callback for copies of the partition kept up to date, or NULL
+
+//---------- partition state functions ----------
+
+// state of a partition, which lets a thread switch between several partitions
+typedef struct partition_state {
+    psize_t pSize;
+    char *pStart;
+    char *pEnd;
+    char *pMap;
+    size_t pMapSize;
+    bool pShared;
+    uint8_t pAllocBackend;
+    size_t pAllocSize;
+    psize_t *vIndex;
+    psize_t iSize;
+    psize_t iUsed;
+    psize_t freeList[FREE_CLASSES];
+    psize_t slackBytes;
+    relocate_fn relocateHook;
+    dirty_fn dirtyHook;
+    unsigned long coalesces;
+    unsigned long compactions;
+    unsigned long compactBytes;
+    double compactSeconds;
+} partition_state;
+
+// function to save the state of the current partition
+static inline void save_partition_state(partition_state *s) {
+    s->pSize = pSize;
+    s->pStart = pStart;
+    s->pEnd = pEnd;
+    s->pMap = pMap;
+    s->pMapSize = pMapSize;
+    s->pShared = pShared;
+    s->pAllocBackend = pAllocBackend;
+    s->pAllocSize = pAllocSize;
+    s->vIndex = vIndex;
+    s->iSize = iSize;
+    s->iUsed = iUsed;
+    memcpy(s->freeList, freeList, sizeof(freeList));
+    s->slackBytes = slackBytes;
+    s->relocateHook = relocateHook;
+    s->dirtyHook = dirtyHook;
+    s->coalesces = coalesces;
+    s->compactions = compactions;
+    s->compactBytes = compactBytes;
+    s->compactSeconds = compactSeconds;
+}
+
+// function to make a saved partition the current one
+static inline void use_partition_state(partition_state *s) {
+    pSize = s->pSize;
+    pStart = s->pStart;
+    pEnd = s->pEnd;
+    pMap = s->pMap;
+    pMapSize = s->pMapSize;
+    pShared = s->pShared;
+    pAllocBackend = s->pAllocBackend;
+    pAllocSize = s->pAllocSize;
+    vIndex = s->vIndex;
+    iSize = s->iSize;
+    iUsed = s->iUsed;
+    memcpy(freeList, s->freeList, sizeof(freeList));
+    slackBytes = s->slackBytes;
+    relocateHook = s->relocateHook;
+    dirtyHook = s->dirtyHook;
+    coalesces = s->coalesces;
+    compactions = s->compactions;
+    compactBytes = s->compactBytes;
+    compactSeconds = s->compactSeconds;
+}
+
+//---------- change tracking functions ----------
+
+// function to set the callback which is told about the changed bytes of the partition and the index
+static inline void set_dirty_hook(dirty_fn hook) {
+    dirtyHook = hook;
+}
+
+// function to tell the change callback about changed bytes of the partition
+static inline void mark_partition(char *p, size_t size) {
+    if (dirtyHook != NULL) {
+        dirtyHook(false, p - pStart, size);
+    }
+}
+
+// function to tell the change callback about changed slots of the index
+static inline void mark_index(psize_t *slot, size_t count) {
+    if (dirtyHook != NULL) {
+        dirtyHook(true, (char *)slot - (char *)vIndex, count * sizeof(psize_t));
+    }
+}
 
 //---------- z-string functions ----------
 
 // function to get a c-string from a z-string buffer
-static char *get_zstring(char *zBuf, char* cBuf) {
+static inline char *get_zstring(char *zBuf, char* cBuf) {
     // get the size of the z-string buffer
     uint8_t size = *zBuf;
     // copy the c-string from the z-string buffer into the c-string buffer
@@ -53,7 +264,7 @@ static char *get_zstring(char *zBuf, char* cBuf) {
 }
 
 // function to set a c-string into a z-string buffer
-static uint8_t set_zstring(char *zBuf, char size, char *s) {
+static inline uint8_t set_zstring(char *zBuf, size_t size, char *s) {
     // check if the c-string is too long
     if (size > 255) {
         printf("Error: string '%s' is too long\n", s);
@@ -70,13 +281,26 @@ static uint8_t set_zstring(char *zBuf, char size, char *s) {
 //---------- variable functions ----------
 
 // function to get the size of an element in the partition
-static uint16_t get_element_size(char *p) {
-    uint16_t size = *((uint16_t *)(p + 1));
+static inline psize_t get_element_size(char *p) {
+    psize_t size = *((psize_t *)(p + 1));
     return size;
 }
 
+// function to set the size of an element in the partition
+static inline void set_element_size(char *p, psize_t size) {
+    *((psize_t *)(p + 1)) = size;
+    // the type is usually set along with the size, so both are reported
+    mark_partition(p, ELEMENT_HEADER_SIZE);
+}
+
+// function to get the type of an element in the partition, without the PREV_FREE flag
+static inline uint8_t get_element_type(char *p) {
+    uint8_t type = *p;
+    return type == 0xff ? type : type & ~PREV_FREE;
+}
+
 // function to check if a string is a valid variable name
-static bool is_valid_var_name(char *name) {
+static inline bool is_valid_var_name(char *name) {
     // check if the first character is a letter
     if (!isalpha(*name)) {
         return false;
@@ -92,53 +316,58 @@ static bool is_valid_var_name(char *name) {
 }
 
 // function to get the size of a variable loaded into a variable buffer
-static uint16_t get_var_size(char *vBuf) {
+static inline uint16_t get_var_size(char *vBuf) {
     uint8_t nameSize = *(vBuf + 1);
     uint8_t valueSize = *(vBuf + 2 + nameSize);
     return nameSize + valueSize + 3;
 }
 
+// function to get the bytes a variable element leaves unused after its variable
+static inline psize_t get_var_slack(char *p) {
+    return get_element_size(p) - ELEMENT_HEADER_SIZE - get_var_size(p + ELEMENT_HEADER_SIZE);
+}
+
 // function to get the type of a variable loaded into a variable buffer
-static uint8_t get_var_type(char *vBuf) {
+static inline uint8_t get_var_type(char *vBuf) {
     return *vBuf;
 }
 
 // function to get the name of a variable loaded into a variable buffer
-static char *get_var_name(char *vBuf) {
+static inline char *get_var_name(char *vBuf) {
     return get_zstring(vBuf + 1, cBuf);
 }
 
 // function to get the value of a variable loaded into a variable buffer as a boolean
-static bool get_var_bool(char *vBuf) {
+static inline bool get_var_bool(char *vBuf) {
     return *(vBuf + *(vBuf + 1) + 3);
 }
 
 // function to get the value of a variable loaded into a variable buffer as a char
-static char get_var_char(char *vBuf) {
+static inline char get_var_char(char *vBuf) {
     return *(vBuf + *(vBuf + 1) + 3);
 }
 
 // function to get the value of a variable loaded into a variable buffer as an integer
-static int get_var_int(char *vBuf) {
+static inline int get_var_int(char *vBuf) {
     return *((int *)(vBuf + *(vBuf + 1) + 3));
 }
 
 // function to get the value of a variable loaded into a variable buffer as a float
-static float get_var_float(char *vBuf) {
+static inline float get_var_float(char *vBuf) {
     return *((float *)(vBuf + *(vBuf + 1) + 3));
 }
 
 // function to get the value of a variable loaded into a variable buffer as a z-string
-static char *get_var_zstr(char *vBuf) {
+static inline char *get_var_zstr(char *vBuf) {
     return vBuf + 2 + *(vBuf + 1);
 }
 
 // function to load a variable of the specified type, name, size and value onto a variable buffer
-static uint8_t load_var(char *vBuf, char type, char *name, char size, char *value) {
+static inline uint8_t load_var(char *vBuf, char type, char *name, size_t size, char *value) {
     // declare a variable to store an error code
     uint8_t err = 0;
     // get the size of the variable name
-    uint8_t nameSize = strlen(name);
+    size_t nameSize = strlen(name);
     // check if the variable name is valid
     if (!is_valid_var_name(name)) {
         printf("Error: invalid variable name '%s'\n", name);
@@ -157,183 +386,864 @@ static uint8_t load_var(char *vBuf, char type, char *name, char size, char *valu
 }
 
 // function to load a null variable of the specified name onto a variable buffer
-static uint8_t load_null_var(char *vBuf, char *name) {
+static inline uint8_t load_null_var(char *vBuf, char *name) {
     return load_var(vBuf, 0x00, name, 0, "");
 }
 
 // function to load a boolean variable of the specified name and value onto a variable buffer
-static uint8_t load_bool_var(char *vBuf, char *name, bool value) {
+static inline uint8_t load_bool_var(char *vBuf, char *name, bool value) {
     return load_var(vBuf, 0x01, name, sizeof(bool), (char*)&value);
 }
 
 // function to load a char variable of the specified name and value onto a variable buffer
-static uint8_t load_char_var(char *vBuf, char *name, char value) {
+static inline uint8_t load_char_var(char *vBuf, char *name, char value) {
     return load_var(vBuf, 0x02, name, sizeof(char), &value);
 }
 
 // function to load an integer variable of the specified name and value onto a variable buffer
-static uint8_t load_int_var(char *vBuf, char *name, int value) {
+static inline uint8_t load_int_var(char *vBuf, char *name, int value) {
     return load_var(vBuf, 0x03, name, sizeof(int), (char*)&value);
 }
 
 // function to load a float variable of the specified name and value onto a variable buffer
-static uint8_t load_float_var(char *vBuf, char *name, float value) {
+static inline uint8_t load_float_var(char *vBuf, char *name, float value) {
     return load_var(vBuf, 0x04, name, sizeof(float), (char*)&value);
 }
 
 // function to load a string variable of the specified name and value onto a variable buffer
-static uint8_t load_string_var(char *vBuf, char *name, char *value) {
-    uint16_t size = strlen(value);
-    return load_var(vBuf, 0x05, name, size, value);
+static inline uint8_t load_string_var(char *vBuf, char *name, char *value) {
+    return load_var(vBuf, 0x05, name, strlen(value), value);
+}
+
+//---------- index functions ----------
+
+// function to compute the FNV-1a hash of a variable name
+static inline uint32_t name_hash(char *name, uint8_t size) {
+    uint32_t hash = 2166136261u;
+    while (size--) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+// function to hash a variable name to an index slot
+static inline psize_t hash_name(char *name, uint8_t size) {
+    return name_hash(name, size) & (iSize - 1);
+}
+
+// function to check if the variable element at the partition offset has the specified name
+static inline bool var_name_equals(psize_t offset, char *name, uint8_t size) {
+    char *v = pStart + offset + ELEMENT_HEADER_SIZE;
+    return (uint8_t)v[1] == size && memcmp(v + 2, name, size) == 0;
+}
+
+// function to find the index slot of a variable, returns NULL if the variable is not indexed
+static inline psize_t *find_slot(char *name, uint8_t size) {
+    psize_t i = hash_name(name, size);
+    // probe linearly until an empty slot ends the chain, skipping deleted slots
+    while (vIndex[i] != INDEX_EMPTY) {
+        if (vIndex[i] != INDEX_DELETED && var_name_equals(vIndex[i] - 1, name, size)) {
+            return &vIndex[i];
+        }
+        i = (i + 1) & (iSize - 1);
+    }
+    return NULL;
+}
+
+// function to add a variable element to the index without checking the load
+static inline void insert_slot(char *p) {
+    char *v = p + ELEMENT_HEADER_SIZE;
+    psize_t i = hash_name(v + 2, v[1]);
+    // reuse the first deleted slot on the chain or take the empty slot at its end
+    while (vIndex[i] != INDEX_EMPTY && vIndex[i] != INDEX_DELETED) {
+        i = (i + 1) & (iSize - 1);
+    }
+    if (vIndex[i] == INDEX_EMPTY) {
+        iUsed++;
+    }
+    vIndex[i] = p - pStart + 1;
+    mark_index(&vIndex[i], 1);
+}
+
+// function to rebuild the index from the variable elements in the partition, dropping the deleted markers
+static inline void rebuild_index(void) {
+    memset(vIndex, 0, iSize * sizeof(psize_t));
+    mark_index(vIndex, iSize);
+    iUsed = 0;
+    char *p = pStart;
+    while (p < pEnd) {
+        if (get_element_type(p) == 0x01) {
+            insert_slot(p);
+        }
+        p += get_element_size(p);
+    }
+}
+
+// function to move the index slot of a variable element relocated by compaction
+static inline void reindex_var(char *from, char *to) {
+    psize_t link = from - pStart + 1;
+    char *v = to + ELEMENT_HEADER_SIZE;
+    // the name hashes the same at the new position, so the slot is on its chain
+    psize_t i = hash_name(v + 2, v[1]);
+    while (vIndex[i] != link) {
+        i = (i + 1) & (iSize - 1);
+    }
+    vIndex[i] = to - pStart + 1;
+    mark_index(&vIndex[i], 1);
+}
+
+// function to add a variable element to the index, which reserve_slot made room for
+static inline void index_var(char *p) {
+    insert_slot(p);
+}
+
+// function to get the number of index slots for a number of variables, keeping the index at most half full
+static inline psize_t index_slots(psize_t vars) {
+    // the partition holds at most MAX_PARTITION_SIZE / MIN_VAR_ELEMENT_SIZE variables, so the doubling can't overflow
+    psize_t n = MIN_INDEX_SLOTS;
+    while (n < vars * 2) {
+        n *= 2;
+    }
+    return n;
+}
+
+// function to allocate the variable index with the specified number of slots, the index must be rebuilt or cleared afterwards
+static inline void alloc_index(psize_t slots) {
+    psize_t *index = realloc(vIndex, slots * sizeof(psize_t));
+    if (index == NULL) {
+        printf("Error: could not allocate index of size %lu\n", (unsigned long)slots);
+        exit(1);
+    }
+    vIndex = index;
+    iSize = slots;
+}
+
+//---------- free list functions ----------
+
+// Deleted blocks are linked into one doubly linked list per size class.
+// The links are kept in the block itself, right after the element header, and are as wide as the element size:
+//      <next> is the offset plus one of the next block in the list, or 0
+//      <prev> is the offset plus one of the previous block in the list, or 0
+// The block ends with a copy of its size, so the block can be found from the element that follows it, which has the
+// PREV_FREE flag set in its type. Deleted blocks are never next to each other in the free lists, so a deleted block never
+// has the flag.
+
+// function to get the size class of a block
+static inline uint8_t size_class(psize_t size) {
+    uint8_t c = 0;
+    size >>= 3;
+    while (size) {
+        c++;
+        size >>= 1;
+    }
+    return c;
+}
+
+// function to get the block a free list link points to
+static inline char *free_block(psize_t link) {
+    return link ? pStart + link - 1 : NULL;
+}
+
+// function to get the link to the next block in the free list of a deleted block
+static inline psize_t *next_link(char *p) {
+    return (psize_t *)(p + ELEMENT_HEADER_SIZE);
+}
+
+// function to get the link to the previous block in the free list of a deleted block
+static inline psize_t *prev_link(char *p) {
+    return (psize_t *)(p + ELEMENT_HEADER_SIZE + sizeof(psize_t));
+}
+
+// function to set or clear the PREV_FREE flag of the live element or empty area following a block
+static inline void set_prev_free(char *p, bool prevFree) {
+    *p = prevFree ? *p | PREV_FREE : *p & ~PREV_FREE;
+    mark_partition(p, 1);
+}
+
+// function to clear the free lists
+static inline void clear_free_lists(void) {
+    memset(freeList, 0, sizeof(freeList));
+}
+
+// function to add a deleted block to the free list of its size class
+static inline void link_free(char *p) {
+    psize_t size = get_element_size(p);
+    psize_t *head = &freeList[size_class(size)];
+    psize_t link = p - pStart + 1;
+    // write the size footer
+    *((psize_t *)(p + size - sizeof(psize_t))) = size;
+    mark_partition(p + size - sizeof(psize_t), sizeof(psize_t));
+    // push the block at the front of the list
+    *next_link(p) = *head;
+    *prev_link(p) = 0;
+    mark_partition((char *)next_link(p), 2 * sizeof(psize_t));
+    if (*head) {
+        *prev_link(free_block(*head)) = link;
+        mark_partition((char *)prev_link(free_block(*head)), sizeof(psize_t));
+    }
+    *head = link;
+}
+
+// function to remove a deleted block from the free list of its size class
+static inline void unlink_free(char *p) {
+    psize_t next = *next_link(p);
+    psize_t prev = *prev_link(p);
+    if (prev) {
+        *next_link(free_block(prev)) = next;
+        mark_partition((char *)next_link(free_block(prev)), sizeof(psize_t));
+    } else {
+        freeList[size_class(get_element_size(p))] = next;
+    }
+    if (next) {
+        *prev_link(free_block(next)) = prev;
+        mark_partition((char *)prev_link(free_block(next)), sizeof(psize_t));
+    }
+}
+
+// function to get the deleted block right before an element, returns NULL if there's none
+static inline char *prev_free_block(char *p) {
+    // the size footer is only read when the allocator flagged the previous element as a deleted block
+    if ((uint8_t)*p == 0xff || !(*p & PREV_FREE)) {
+        return NULL;
+    }
+    return p - *((psize_t *)(p - sizeof(psize_t)));
+}
+
+// function to take a deleted block of at least the specified size from the free lists, returns NULL if there's none
+static inline char *take_free_block(psize_t eSize) {
+    uint8_t c = size_class(eSize);
+    // first fit in the size class of the element, which can hold blocks smaller than the element
+    char *p = free_block(freeList[c]);
+    while (p != NULL && get_element_size(p) < eSize) {
+        p = free_block(*next_link(p));
+    }
+    // any block in a larger size class is large enough
+    while (p == NULL && ++c < FREE_CLASSES) {
+        p = free_block(freeList[c]);
+    }
+    if (p == NULL) {
+        return NULL;
+    }
+    unlink_free(p);
+
+    // split the block if the remainder is large enough to be a deleted block, otherwise the element keeps it as slack
+    // and the element after it no longer follows a deleted block
+    psize_t size = get_element_size(p);
+    if ((psize_t)(size - eSize) >= MIN_BLOCK_SIZE) {
+        char *r = p + eSize;
+        *r = 0xff;
+        set_element_size(r, size - eSize);
+        link_free(r);
+        set_element_size(p, eSize);
+    } else {
+        set_prev_free(p + size, false);
+    }
+    return p;
+}
+
+//---------- partition allocation functions ----------
+
+// function to select the backend and the prefaulting of the partitions allocated from now on
+static inline void set_partition_backend(uint8_t backend, bool prefault) {
+    pBackend = backend;
+    pPrefault = prefault;
+}
+
+#ifdef HAVE_MMAP
+// function to map anonymous memory, returns NULL if it can't
+static inline char *map_anonymous(size_t size, int flags) {
+    char *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+#endif
+
+// function to allocate partition memory from the requested backend or the first available one after it
+static inline char *backend_alloc(size_t size, uint8_t *backend, size_t *allocSize) {
+    char *p = NULL;
+    *backend = pBackend;
+    *allocSize = size;
+#ifdef HAVE_MMAP
+    // the huge page backends round the size up to whole huge pages
+    size_t hugeSize = (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+    if (*backend == BACKEND_HUGETLB && (p = map_anonymous(hugeSize, MAP_HUGETLB)) != NULL) {
+        *allocSize = hugeSize;
+    }
+#endif
+    if (p == NULL && *backend >= BACKEND_HUGEPAGE) {
+        *backend = BACKEND_HUGEPAGE;
+        if ((p = map_anonymous(hugeSize, 0)) != NULL) {
+            *allocSize = hugeSize;
+#ifdef MADV_HUGEPAGE
+            // the advice is only a hint, the mapping works without it
+            madvise(p, hugeSize, MADV_HUGEPAGE);
+#endif
+        }
+    }
+    if (p == NULL && *backend >= BACKEND_MMAP) {
+        *backend = BACKEND_MMAP;
+        p = map_anonymous(size, 0);
+    }
+#endif
+    if (p == NULL) {
+        *backend = BACKEND_MALLOC;
+        p = malloc(size);
+    }
+    // write to every page so the faults happen now rather than during the first scans
+    if (p != NULL && pPrefault) {
+        memset(p, 0, *allocSize);
+    }
+    return p;
+}
+
+// function to free partition memory from the backend it was allocated from
+static inline void backend_free(char *p, uint8_t backend, size_t allocSize) {
+#ifdef HAVE_MMAP
+    if (backend != BACKEND_MALLOC) {
+        munmap(p, allocSize);
+        return;
+    }
+#endif
+    free(p);
 }
 
 //---------- partition functions ----------
 
+// function to move a partition loaded from a snapshot mapping onto the heap, so it can be reallocated
+static inline void detach_partition(void) {
+    if (pMap == NULL) {
+        return;
+    }
+    char *p = backend_alloc(pSize, &pAllocBackend, &pAllocSize);
+    psize_t *index = malloc(iSize * sizeof(psize_t));
+    if (p == NULL || index == NULL) {
+        printf("Error: could not allocate partition of size %lu\n", (unsigned long)pSize);
+        exit(1);
+    }
+    memcpy(p, pStart, pSize);
+    memcpy(index, vIndex, iSize * sizeof(psize_t));
+    pEnd = p + (pEnd - pStart);
+    pStart = p;
+    vIndex = index;
+#ifdef HAVE_MMAP
+    munmap(pMap, pMapSize);
+#else
+    free(pMap);
+#endif
+    pMap = NULL;
+}
+
+// function to free the partition and the index
+static inline void free_partition(void) {
+    if (pMap != NULL) {
+#ifdef HAVE_MMAP
+        munmap(pMap, pMapSize);
+#else
+        free(pMap);
+#endif
+        pMap = NULL;
+        pShared = false;
+    } else {
+        backend_free(pStart, pAllocBackend, pAllocSize);
+        free(vIndex);
+    }
+    pStart = pEnd = NULL;
+    vIndex = NULL;
+}
+
 // function to allocate a partition
-static void alloc_partition(void) {
+static inline void alloc_partition(void) {
     // get the partition size from the patch area
     pSize = *((uint16_t *)&patch[6]);
     // allocate the partition and check if it was successful
-    if ((pStart = malloc(pSize)) == NULL) {
-        printf("Error: could not allocate partition of size %d\n", pSize);
+    if ((pStart = backend_alloc(pSize, &pAllocBackend, &pAllocSize)) == NULL) {
+        printf("Error: could not allocate partition of size %lu\n", (unsigned long)pSize);
         exit(1);
     }
+    // allocate the variable index
+    alloc_index(MIN_INDEX_SLOTS);
 }
 
 // function to initialize an empty area
-static char *init_empty_area(char *p, uint16_t size) {
+static inline char *init_empty_area(char *p, psize_t size) {
     *p = 0x00;
-    *((uint16_t *)(p + 1)) = size;
+    set_element_size(p, size);
     return p;
 }
 
 // function to initialize the partition as a single empty area
-static void init_partition(void) {
+static inline void init_partition(void) {
     pSize = *((uint16_t *)&patch[6]);
     pEnd = init_empty_area(pStart, pSize);
+    // clear the free lists
+    clear_free_lists();
+    slackBytes = 0;
+    // clear the variable index
+    memset(vIndex, 0, iSize * sizeof(psize_t));
+    mark_index(vIndex, iSize);
+    iUsed = 0;
 }
 
 // function to add an element to the partition
-static char *add_element(char *p, uint8_t type, char *eBuf, uint16_t size) {
+static inline char *add_element(char *p, uint8_t type, char *eBuf, uint16_t size) {
     // set the element type
     *p = type;
     // set the element size
-    *((uint16_t *)(p + 1)) = size + 3;
+    set_element_size(p, size + ELEMENT_HEADER_SIZE);
     // add the element to the partition position
-    memcpy(p + 3, eBuf, size);
+    memcpy(p + ELEMENT_HEADER_SIZE, eBuf, size);
+    mark_partition(p, size + ELEMENT_HEADER_SIZE);
     // return the next partition position
-    return p + size + 3;
+    return p + size + ELEMENT_HEADER_SIZE;
 }
 
-// function to compact the partition
-static bool compact_partition(char *p) {
-    // if the partition is empty, return
-    if (p == pEnd) {
-        return true;
+// function to set the callback which is told where compaction moves each element
+static inline void set_relocate_hook(relocate_fn hook) {
+    relocateHook = hook;
+}
+
+// function to tell the index and the relocation callback about the elements of a moved run
+static inline void relocate_run(char *from, char *to, psize_t size) {
+    char *end = to + size;
+    while (to < end) {
+        if (get_element_type(to) == 0x01) {
+            reindex_var(from, to);
+        }
+        if (relocateHook != NULL) {
+            relocateHook(from - pStart, to - pStart);
+        }
+        psize_t eSize = get_element_size(to);
+        from += eSize;
+        to += eSize;
     }
+}
 
-    // get the type of the element
-    uint8_t type = *p;
-    // get the size of the element
-    uint16_t size = get_element_size(p);
+// function to compact the partition
+// the live elements from p onwards slide down over the deleted ones in a single pass, each run of live elements is moved once
+static inline void compact_partition(char *p) {
+    clock_t start = clock();
+    char *dst = p;
+    char *run;
 
-    // if the element is deleted, move the remainder of the partition over the deleted element
-    if (type == 0xff) {
-        // move the remainder of the partition over the deleted element
-        memmove(p, p + size, pEnd - p - size);
-        // set the end of the partition
-        pEnd -= size;
-        // compact the partition
-        return compact_partition(p);
+    while (p < pEnd) {
+        // skip the deleted elements
+        if ((uint8_t)*p == 0xff) {
+            p += get_element_size(p);
+            continue;
+        }
+        // find the end of the run of live elements, the first one no longer follows a deleted block
+        set_prev_free(p, false);
+        run = p;
+        while (p < pEnd && (uint8_t)*p != 0xff) {
+            p += get_element_size(p);
+        }
+        // move the run over the deleted elements before it
+        if (dst != run) {
+            memmove(dst, run, p - run);
+            mark_partition(dst, p - run);
+            relocate_run(run, dst, p - run);
+            compactBytes += p - run;
+        }
+        dst += p - run;
     }
 
-    // move to the next element
-    return compact_partition(p + size);
+    // the deleted elements are gone, so the free lists are empty and the rest of the partition is the empty area
+    pEnd = init_empty_area(dst, pSize - (dst - pStart));
+    clear_free_lists();
+
+    compactions++;
+    compactSeconds += (double)(clock() - start) / CLOCKS_PER_SEC;
 }
 
-// function to add a variable element to the partition
-static uint8_t add_var(char *v) {
-    // get the size of the variable in the buffer
-    uint16_t vSize = get_var_size(v);
-    // add 3 to the size of the variable in the buffer to account for the element type and size fields
-    uint16_t eSize = vSize + 3;
+// function to grow the partition by at least the specified number of bytes, returns false if it can't grow
+// only wide partitions grow, elements keep their offsets but pointers into the partition must be looked up again
+static inline bool grow_partition(psize_t needed) {
+#ifdef WIDE_PARTITION
+    // a shared partition has a fixed size, a partition mapped from a snapshot must be copied to the heap first
+    if (pShared) {
+        return false;
+    }
+    detach_partition();
+    psize_t used = pEnd - pStart;
+    // double the partition, or more if needed, up to the largest partition size
+    unsigned long long size = (unsigned long long)pSize * 2;
+    if (size < (unsigned long long)pSize + needed) {
+        size = (unsigned long long)pSize + needed;
+    }
+    if (size > MAX_PARTITION_SIZE) {
+        size = MAX_PARTITION_SIZE;
+    }
+    if (size < (unsigned long long)pSize + needed) {
+        return false;
+    }
+    // reallocate the partition unless its allocation already has room, then extend the empty area at the end
+    if (size > pAllocSize) {
+        uint8_t backend;
+        size_t allocSize;
+        char *p;
+        if (pAllocBackend == BACKEND_MALLOC && pBackend == BACKEND_MALLOC) {
+            p = realloc(pStart, size);
+            backend = BACKEND_MALLOC;
+            allocSize = size;
+            // realloc copied the old allocation, only the pages after it are new
+            if (p != NULL && pPrefault) {
+                memset(p + pAllocSize, 0, size - pAllocSize);
+            }
+        } else if ((p = backend_alloc(size, &backend, &allocSize)) != NULL) {
+            memcpy(p, pStart, used);
+            backend_free(pStart, pAllocBackend, pAllocSize);
+        }
+        if (p == NULL) {
+            return false;
+        }
+        pStart = p;
+        pAllocBackend = backend;
+        pAllocSize = allocSize;
+    }
+    pSize = size;
+    pEnd = init_empty_area(pStart + used, pSize - used);
+    return true;
+#else
+    (void)needed;
+    return false;
+#endif
+}
 
-    char *pPos;
+// function to make room in the index for one more variable, returns false if the index is full and can't grow
+// the index is rebuilt once its used slots, deleted markers included, pass three quarters of it, and resized so that the
+// live variables fill at most half of it; a shared index has a fixed size and is only rebuilt
+static inline bool reserve_slot(void) {
+    if (iUsed + 1 <= iSize / 4 * 3) {
+        return true;
+    }
+    // count the live variables, the deleted markers go away with the rebuild
+    psize_t vars = 1;
+    char *p = pStart;
+    while (p < pEnd) {
+        if (get_element_type(p) == 0x01) {
+            vars++;
+        }
+        p += get_element_size(p);
+    }
+    if (pShared) {
+        if (vars > iSize / 4 * 3) {
+            return false;
+        }
+    } else if (index_slots(vars) != iSize) {
+        // the index of a partition mapped from a snapshot must be copied to the heap first
+        detach_partition();
+        alloc_index(index_slots(vars));
+    }
+    rebuild_index();
+    return true;
+}
 
-    // if the free area at the end of the partition is large enough to hold the variable in the buffer, add the variable to the end of the partition
-    if (eSize <= get_element_size(pEnd)) {
-        // add the variable to the end of the partition
-        pPos = add_element(pEnd, 0x01, v, vSize);
+// function to reserve an element of the specified size in the partition, returns an error code
+// the element keeps the size of the block it got, which includes any slack left by a split, and its type is left to the caller
+static inline uint8_t reserve_element(psize_t eSize, char **p) {
+    // if the free area at the end of the partition is large enough to hold the element and its own header, take the element from it
+    if (eSize + ELEMENT_HEADER_SIZE <= get_element_size(pEnd)) {
+        *p = pEnd;
+        set_element_size(*p, eSize);
         // initialize the empty area at the end of the partition
-        pEnd = init_empty_area(pPos, pSize - (pPos - pStart));
+        pEnd = init_empty_area(*p + eSize, pSize - (*p + eSize - pStart));
         // return no error
         return 0;
     }
 
-    // scan each element in the partition to find a deleted element which size is of the same size as the variable in the buffer
-    char *p = pStart;
-    while (p < pEnd) {
-        // get the type of the element
-        uint8_t type = *p;
-        // get the size of the element
-        uint16_t size = get_element_size(p);
-
-        // if the element is deleted and the size is the same as the variable in the buffer, add the variable to the deleted element
-        if (type == 0xff && size == eSize) {
-            // add the variable to the deleted element
-            pPos = add_element(p, 0x01, v, vSize);
-            // return no error            
-            return 0;
-        }
-
-        // move to the next element
-        p += size;
+    // take a deleted block large enough to hold the element from the free lists
+    if ((*p = take_free_block(eSize)) != NULL) {
+        // return no error
+        return 0;
     }
 
     // compact the partition
-    if (!compact_partition(pStart)) {
-        printf("Error: compacting partition\n");
-        return 4;
+    compact_partition(pStart);
+
+    // if the free area at the end of the partition is still not large enough to hold the element, grow the partition or return false
+    if (eSize + ELEMENT_HEADER_SIZE > get_element_size(pEnd) && !grow_partition(eSize + ELEMENT_HEADER_SIZE - get_element_size(pEnd))) {
+        printf("Error: partition full\n");
+        return 5;
     }
 
-    // if the free area at the end of the partition is still not large enough to hold the variable in the buffer, return false
-    if (eSize > get_element_size(pEnd)) {
+    // take the element from the end of the partition
+    return reserve_element(eSize, p);
+}
+
+// function to add a variable element to the partition
+static inline uint8_t add_var(char *v) {
+    // get the size of the variable in the buffer
+    uint16_t vSize = get_var_size(v);
+    char *p;
+
+    // make room for the variable in the index
+    if (!reserve_slot()) {
         printf("Error: partition full\n");
         return 5;
     }
+    // reserve an element for the variable, adding the size of the element type and size fields
+    uint8_t err = reserve_element(vSize + ELEMENT_HEADER_SIZE, &p);
+    if (err) {
+        return err;
+    }
+    // add the variable to the element, keeping the element size
+    psize_t size = get_element_size(p);
+    add_element(p, 0x01, v, vSize);
+    set_element_size(p, size);
+    slackBytes += get_var_slack(p);
+    // index the variable
+    index_var(p);
+    // return no error
+    return 0;
+}
 
-    // add the variable to the end of the partition
-    return add_var(v);
+// function to write a variable of the specified type, name, size and value into a reserved element
+static inline void write_var(char *p, char type, char *name, uint8_t nameSize, uint8_t size, char *value) {
+    // set the element type and write the variable type, name and value
+    *p = 0x01;
+    char *v = p + ELEMENT_HEADER_SIZE;
+    v[0] = type;
+    v[1] = nameSize;
+    memcpy(v + 2, name, nameSize);
+    v[2 + nameSize] = size;
+    memcpy(v + 3 + nameSize, value, size);
+    mark_partition(p, nameSize + size + 3 + ELEMENT_HEADER_SIZE);
+    slackBytes += get_var_slack(p);
 }
 
-// function to delete a variable element from the partition
-static bool delete_var(char *name) {
-    // scan each element in the partition to find the variable
+// function to add a variable of the specified type, name, size and value to the partition, writing it in place without a variable buffer
+static inline uint8_t emplace_var(char type, char *name, uint8_t size, char *value) {
+    // get the size of the variable name
+    size_t nameSize = strlen(name);
+    char *p;
+    // check if the variable name is valid
+    if (!is_valid_var_name(name) || nameSize > 255) {
+        printf("Error: invalid variable name '%s'\n", name);
+        return 3;
+    }
+    // make room for the variable in the index
+    if (!reserve_slot()) {
+        printf("Error: partition full\n");
+        return 5;
+    }
+    // reserve an element for the variable
+    uint8_t err = reserve_element(nameSize + size + 3 + ELEMENT_HEADER_SIZE, &p);
+    if (err) {
+        return err;
+    }
+    write_var(p, type, name, nameSize, size, value);
+    // index the variable
+    index_var(p);
+    // return no error
+    return 0;
+}
+
+// function to add a null variable of the specified name to the partition
+static inline uint8_t emplace_null_var(char *name) {
+    return emplace_var(0x00, name, 0, "");
+}
+
+// function to add a boolean variable of the specified name and value to the partition
+static inline uint8_t emplace_bool_var(char *name, bool value) {
+    return emplace_var(0x01, name, sizeof(bool), (char*)&value);
+}
+
+// function to add a char variable of the specified name and value to the partition
+static inline uint8_t emplace_char_var(char *name, char value) {
+    return emplace_var(0x02, name, sizeof(char), &value);
+}
+
+// function to add an integer variable of the specified name and value to the partition
+static inline uint8_t emplace_int_var(char *name, int value) {
+    return emplace_var(0x03, name, sizeof(int), (char*)&value);
+}
+
+// function to add a float variable of the specified name and value to the partition
+static inline uint8_t emplace_float_var(char *name, float value) {
+    return emplace_var(0x04, name, sizeof(float), (char*)&value);
+}
+
+// function to add a string variable of the specified name and value to the partition
+static inline uint8_t emplace_string_var(char *name, char *value) {
+    size_t size = strlen(value);
+    // check if the string is too long
+    if (size > 255) {
+        printf("Error: string '%s' is too long\n", value);
+        return 2;
+    }
+    return emplace_var(0x05, name, size, value);
+}
+
+// function to release the block of a deleted element, merging it with the deleted blocks and the empty area around it
+static inline void release_block(char *p) {
+    psize_t size = get_element_size(p);
+    char *q = p + size;
+
+    // merge the deleted blocks which follow
+    while (q < pEnd && (uint8_t)*q == 0xff) {
+        psize_t qSize = get_element_size(q);
+        if (qSize >= MIN_BLOCK_SIZE) {
+            unlink_free(q);
+        }
+        size += qSize;
+        q += qSize;
+        coalesces++;
+    }
+    // merge the deleted block before
+    char *b = prev_free_block(p);
+    if (b != NULL) {
+        unlink_free(b);
+        size += p - b;
+        p = b;
+        coalesces++;
+    }
+    // a block reaching the empty area at the end of the partition becomes part of it
+    if (q == pEnd) {
+        pEnd = init_empty_area(p, pSize - (p - pStart));
+        return;
+    }
+    // set the element type to 0xff (deleted) and add it to the free lists if it can hold the links
+    *p = 0xff;
+    set_element_size(p, size);
+    if (size >= MIN_BLOCK_SIZE) {
+        link_free(p);
+    }
+    // flag the element after the block, which can then find it through the size footer
+    set_prev_free(q, size >= MIN_BLOCK_SIZE);
+}
+
+// function to measure the fragmentation of the free space, counting the deleted blocks and the empty area at the end
+static inline void get_fragmentation(psize_t *freeBytes, psize_t *freeBlocks, psize_t *largest) {
+    // start with the empty area at the end
+    *freeBytes = *largest = get_element_size(pEnd);
+    *freeBlocks = 1;
+    // add the deleted blocks
     char *p = pStart;
     while (p < pEnd) {
-        // get the type of the element
-        uint8_t type = *p;
-        // get the size of the element
-        uint16_t size = get_element_size(p);
-
-        // if the element is a variable and the name is the same as the variable name, delete the variable
-        if (type == 0x01 && strcmp(get_var_name(p + 3), name) == 0) {
-            // set the element type to 0xff (deleted)
-            *p = 0xff;
-            // return true
-            return true;
+        psize_t size = get_element_size(p);
+        if ((uint8_t)*p == 0xff) {
+            *freeBytes += size;
+            (*freeBlocks)++;
+            if (size > *largest) {
+                *largest = size;
+            }
         }
-
-        // move to the next element
         p += size;
     }
+}
 
-    // return false
-    return false;
+// function to get the slack in the variable elements, the bytes their variables leave unused after a split or an update
+static inline psize_t get_slack(void) {
+    return slackBytes;
+}
+
+// function to find a variable in the partition, returns a pointer to the variable or NULL if not found
+static inline char *find_var(char *name) {
+    // look the variable up in the index
+    psize_t *slot = find_slot(name, strlen(name));
+    if (slot == NULL) {
+        return NULL;
+    }
+    // return the variable after the element type and size fields
+    return pStart + *slot - 1 + ELEMENT_HEADER_SIZE;
+}
+
+// function to delete a variable element from the partition
+static inline bool delete_var(char *name) {
+    // look the variable up in the index
+    psize_t *slot = find_slot(name, strlen(name));
+    if (slot == NULL) {
+        return false;
+    }
+    // release the element block
+    char *p = pStart + *slot - 1;
+    slackBytes -= get_var_slack(p);
+    release_block(p);
+    // mark the index slot as deleted
+    *slot = INDEX_DELETED;
+    mark_index(slot, 1);
+    // return true
+    return true;
+}
+
+// function to set the value of a variable in the partition, adding the variable if it doesn't exist, returns an error code
+// the value is overwritten in place when the variable element can hold it, the bytes a shorter value leaves unused stay in
+// the element as slack for later updates; otherwise the variable moves to a new element, and keeps its old value if there's
+// no room for it
+// like add_var and delete_var, changes to a shared partition go through shared_update_var, and copy-on-write versions only
+// see them at the next mvcc_publish
+static inline uint8_t update_var(char type, char *name, uint8_t size, char *value) {
+    // look the variable up in the index
+    size_t nameSize = strlen(name);
+    psize_t eSize = nameSize + size + 3 + ELEMENT_HEADER_SIZE;
+    psize_t *slot = find_slot(name, nameSize);
+    if (slot == NULL) {
+        // add the variable
+        return emplace_var(type, name, size, value);
+    }
+    char *p = pStart + *slot - 1;
+    // overwrite the type and value if they fit the element
+    if (eSize <= get_element_size(p)) {
+        char *v = p + ELEMENT_HEADER_SIZE;
+        slackBytes -= get_var_slack(p);
+        v[0] = type;
+        v[2 + nameSize] = size;
+        memcpy(v + 3 + nameSize, value, size);
+        mark_partition(v, nameSize + size + 3);
+        slackBytes += get_var_slack(p);
+        return 0;
+    }
+    // reserve the new element while the old one still holds the variable
+    char *e;
+    uint8_t err = reserve_element(eSize, &e);
+    if (err) {
+        return err;
+    }
+    write_var(e, type, name, nameSize, size, value);
+    // compacting or growing the partition may have moved the old element, look it up again before releasing it
+    slot = find_slot(name, nameSize);
+    p = pStart + *slot - 1;
+    slackBytes -= get_var_slack(p);
+    release_block(p);
+    // point the index slot to the new element
+    *slot = e - pStart + 1;
+    mark_index(slot, 1);
+    return 0;
+}
+
+// function to set the value of a boolean variable in the partition
+static inline uint8_t update_bool_var(char *name, bool value) {
+    return update_var(0x01, name, sizeof(bool), (char*)&value);
+}
+
+// function to set the value of a char variable in the partition
+static inline uint8_t update_char_var(char *name, char value) {
+    return update_var(0x02, name, sizeof(char), &value);
+}
+
+// function to set the value of an integer variable in the partition
+static inline uint8_t update_int_var(char *name, int value) {
+    return update_var(0x03, name, sizeof(int), (char*)&value);
+}
+
+// function to set the value of a float variable in the partition
+static inline uint8_t update_float_var(char *name, float value) {
+    return update_var(0x04, name, sizeof(float), (char*)&value);
+}
+
+// function to set the value of a string variable in the partition
+static inline uint8_t update_string_var(char *name, char *value) {
+    size_t size = strlen(value);
+    // check if the string is too long
+    if (size > 255) {
+        printf("Error: string '%s' is too long\n", value);
+        return 2;
+    }
+    return update_var(0x05, name, size, value);
 }
 
 // function to print a variable
-static void print_var(char *e) {
+static inline void print_var(char *e) {
     // print the variable name
     printf("Name: %s ", get_var_name(e));
     // get the variable type
@@ -390,14 +1300,14 @@ static void print_var(char *e) {
 }
 
 // function to print an element
-static void print_element(char *p) {
+static inline void print_element(char *p) {
     // get the type of the element
-    uint8_t type = *p;
+    uint8_t type = get_element_type(p);
     // get the size of the element
-    uint16_t size = get_element_size(p);
+    psize_t size = get_element_size(p);
 
     // print the size of the element
-    printf("Size: %d ", size);
+    printf("Size: %lu ", (unsigned long)size);
 
     // print the type of the element as "var", "code", "empty" or "deleted"
     switch (type) {
@@ -418,7 +1328,7 @@ static void print_element(char *p) {
         break;
     }
 
-    char *e = p + 3;
+    char *e = p + ELEMENT_HEADER_SIZE;
 
     // print the contents of the element depending on the type
     switch (type) {
@@ -428,20 +1338,26 @@ static void print_element(char *p) {
         break;
     default:
         // print the size of the unknown area
-        printf("Size: %d ", size - 3);
+        printf("Size: %lu ", (unsigned long)(size - ELEMENT_HEADER_SIZE));
         printf("\n");
         break;
     }
 }
 
+// function to print the fragmentation of the free space in the partition
+static inline void print_fragmentation(void) {
+    psize_t freeBytes, freeBlocks, largest;
+    get_fragmentation(&freeBytes, &freeBlocks, &largest);
+    printf("Free: %lu bytes in %lu blocks, largest %lu\n", (unsigned long)freeBytes, (unsigned long)freeBlocks, (unsigned long)largest);
+    printf("Slack: %lu bytes\n", (unsigned long)get_slack());
+}
+
 // function to list all the elements in the partition
-static void list_elements(char *p) {
-    // create a pointer to the element's content
-    char *e;
+static inline void list_elements(char *p) {
     // loop through all the elements in the partition
     while (p < pEnd) {
         // get the size of the element
-        uint16_t size = get_element_size(p);
+        psize_t size = get_element_size(p);
         // print the element
         print_element(p);
         // move to the next element
@@ -449,7 +1365,192 @@ static void list_elements(char *p) {
     }
     printf("End of partition\n");
     // print the size of the empty area at the end of the partition
-    printf("Empty area size: %d\n", get_element_size(pEnd));
+    printf("Empty area size: %lu\n", (unsigned long)get_element_size(pEnd));
+}
+
+//---------- snapshot functions ----------
+
+// A snapshot file holds the partition image as it is in memory, so loading it doesn't rebuild anything:
+//      <header> is the snapshot header, padded to the snapshot alignment
+//      <partition> is the whole partition, padded to the snapshot alignment
+//      <index> is the variable index
+// Snapshots are only loaded by builds with the same partition format.
+
+// snapshot header
+typedef struct snapshot_header {
+    char magic[4];                  // SNAPSHOT_MAGIC
+    uint16_t version;               // SNAPSHOT_VERSION
+    uint8_t sizeWidth;              // size of psize_t in the partition format
+    uint8_t reserved;
+    uint32_t checksum;              // FNV-1a of the header with a zero checksum, the partition and the index
+    psize_t pSize;                  // partition size
+    psize_t used;                   // offset of the empty area at the end of the partition
+    psize_t iSize;                  // number of slots in the index
+    psize_t iUsed;                  // number of used index slots
+    psize_t slack;                  // bytes the variable elements leave unused
+    psize_t freeList[FREE_CLASSES]; // free lists heads
+} snapshot_header;
+
+// function to round a snapshot offset up to the snapshot alignment
+static inline size_t snapshot_align(size_t offset) {
+    return (offset + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1);
+}
+
+// function to add bytes to a snapshot checksum
+static inline uint32_t snapshot_checksum(uint32_t hash, char *p, size_t size) {
+    while (size--) {
+        hash = (hash ^ (uint8_t)*p++) * 16777619u;
+    }
+    return hash;
+}
+
+// function to compute the checksum of a snapshot from its header and the partition and index it describes
+static inline uint32_t snapshot_sum(snapshot_header *h, char *partition, psize_t *index) {
+    // the header is covered as well, except for the checksum itself
+    snapshot_header copy = *h;
+    copy.checksum = 0;
+    uint32_t hash = snapshot_checksum(2166136261u, (char *)&copy, sizeof(copy));
+    hash = snapshot_checksum(hash, partition, h->pSize);
+    return snapshot_checksum(hash, (char *)index, h->iSize * sizeof(psize_t));
+}
+
+// function to save the partition to a snapshot file
+static inline uint8_t save_partition(char *path) {
+    snapshot_header h;
+    char pad[SNAPSHOT_ALIGN] = {0};
+    size_t partitionOffset = snapshot_align(sizeof(h));
+    size_t indexOffset = snapshot_align(partitionOffset + pSize);
+
+    // fill the header
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+    h.version = SNAPSHOT_VERSION;
+    h.sizeWidth = sizeof(psize_t);
+    h.pSize = pSize;
+    h.used = pEnd - pStart;
+    h.iSize = iSize;
+    h.iUsed = iUsed;
+    h.slack = slackBytes;
+    memcpy(h.freeList, freeList, sizeof(freeList));
+    h.checksum = snapshot_sum(&h, pStart, vIndex);
+
+    // write the header, the partition and the index
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        printf("Error: could not create snapshot '%s'\n", path);
+        return 6;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(pad, partitionOffset - sizeof(h), 1, f) <= 1
+        && fwrite(pStart, pSize, 1, f) == 1
+        && fwrite(pad, indexOffset - partitionOffset - pSize, 1, f) <= 1
+        && fwrite(vIndex, iSize * sizeof(psize_t), 1, f) == 1;
+    if (fclose(f) != 0 || !ok) {
+        printf("Error: could not write snapshot '%s'\n", path);
+        return 6;
+    }
+    return 0;
+}
+
+// function to map or read a snapshot file into memory, returns NULL if it can't
+static inline char *read_snapshot(char *path, size_t *size) {
+    char *image = NULL;
+#ifdef HAVE_MMAP
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    // map the file copy-on-write, changes to the partition stay private to the process
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        *size = st.st_size;
+        image = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (image == MAP_FAILED) {
+            image = NULL;
+        }
+    }
+    close(fd);
+#else
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) == 0 && (long)(*size = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0 && (image = malloc(*size)) != NULL) {
+        if (fread(image, *size, 1, f) != 1) {
+            free(image);
+            image = NULL;
+        }
+    }
+    fclose(f);
+#endif
+    return image;
+}
+
+// function to release a snapshot image which was not loaded
+static inline void drop_snapshot(char *image, size_t size) {
+#ifdef HAVE_MMAP
+    munmap(image, size);
+#else
+    free(image);
+#endif
+}
+
+// function to load the partition from a snapshot file, replacing the current one
+// the checksum is only verified if asked, since that reads the whole file
+static inline uint8_t load_partition(char *path, bool verify) {
+    size_t size;
+    char *image = read_snapshot(path, &size);
+    if (image == NULL) {
+        printf("Error: could not open snapshot '%s'\n", path);
+        return 6;
+    }
+
+    // validate the header against the file size
+    snapshot_header *h = (snapshot_header *)image;
+    size_t partitionOffset = snapshot_align(sizeof(*h));
+    size_t indexOffset = 0;
+    bool valid = size >= sizeof(*h)
+        && memcmp(h->magic, SNAPSHOT_MAGIC, 4) == 0
+        && h->version == SNAPSHOT_VERSION
+        && h->sizeWidth == sizeof(psize_t);
+    if (valid) {
+        indexOffset = snapshot_align(partitionOffset + h->pSize);
+        valid = (size_t)h->used + ELEMENT_HEADER_SIZE <= h->pSize
+            && h->iSize >= MIN_INDEX_SLOTS
+            && (h->iSize & (h->iSize - 1)) == 0
+            && h->iUsed < h->iSize
+            && h->slack <= h->used
+            && size >= indexOffset + h->iSize * sizeof(psize_t);
+    }
+    // the empty area at the end must span the rest of the partition
+    if (valid) {
+        valid = get_element_size(image + partitionOffset + h->used) == h->pSize - h->used;
+    }
+    if (valid && verify) {
+        valid = snapshot_sum(h, image + partitionOffset, (psize_t *)(image + indexOffset)) == h->checksum;
+    }
+    if (!valid) {
+        printf("Error: invalid snapshot '%s'\n", path);
+        drop_snapshot(image, size);
+        return 7;
+    }
+
+    // use the partition and the index in place
+    free_partition();
+    pMap = image;
+    pMapSize = size;
+    pSize = h->pSize;
+    pStart = image + partitionOffset;
+    pEnd = pStart + h->used;
+    vIndex = (psize_t *)(image + indexOffset);
+    iSize = h->iSize;
+    iUsed = h->iUsed;
+    slackBytes = h->slack;
+    memcpy(freeList, h->freeList, sizeof(freeList));
+    // the whole partition and index changed
+    mark_partition(pStart, pSize);
+    mark_index(vIndex, iSize);
+    return 0;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "token.h"
+#include "postfix.h"
+#include "bytecode.h"
+#include "parser.h"
+
+// main program
+// compile each expression with the Pratt parser and with the shunting yard
+// print whether both produce the same program, and return 1 if any of them differs
+int main(int argc, char *argv[]) {
+	// define a few unique test expressions, including the ones which exposed differences between the two paths
+	char *exprs[] = {
+		"234",
+		"-49",
+		"234.567",
+		"2+3",
+		"2^3",
+		"2+3*4",
+		"2+3*4^5",
+		"(13 + 2) / 3",
+		"\"abc\"",
+		"'abd\\\"asra'",
+		"int(13 / 4)",
+		"int(13 / -(2+2)) + 1",
+		"int(13 / 4) + 1.0",
+		"2-f(3)-7",
+		"2*f(3)/7",
+		"f(2)^2^f(1)-1",
+		"f(1,2)-3",
+		"f(g(1)-2)*3",
+		"-f(2)-3",
+		"2^-3*4",
+		"2*-3+4",
+		"1-2-3",
+		"2^3^2",
+		"$a[1,2]-f(3)*2",
+		"$a[f(1)-2]*3",
+		"2 + $a[17, int(3/-7)]",
+		"2+",
+		"f(1,,2)"};
+
+	// local variables
+	int i;
+	int error1, error2;
+	int differences = 0;
+
+	// create a lexer context for each path
+	lexContext ctx1, ctx2;
+
+	// create a program for each path
+	program prog1, prog2;
+
+	for (i = 0; i < sizeof(exprs) / sizeof(char *); i++) {
+		initContext(&ctx1, exprs[i]);
+		initContext(&ctx2, exprs[i]);
+		error1 = compileExpr(&ctx1, &prog1);
+		error2 = parseExpr(&ctx2, &prog2);
+		printf("%s = ", exprs[i]);
+		if (error1 != error2) {
+			printf("different errors: %s, %s\n", errorMessages[error1], errorMessages[error2]);
+			differences++;
+		} else if (error1 != ERROR_NONE) {
+			printf("same error: %s\n", errorMessages[error1]);
+		} else if (prog1.size != prog2.size || prog1.depth != prog2.depth || memcmp(prog1.code, prog2.code, prog1.size) != 0) {
+			printf("different programs\n");
+			differences++;
+		} else {
+			printf("same program, %d bytes\n", prog1.size);
+		}
+		if (error1 == ERROR_NONE) {
+			freeProgram(&prog1);
+		}
+		if (error2 == ERROR_NONE) {
+			freeProgram(&prog2);
+		}
+	}
+	printf("%d differences\n", differences);
+	return differences != 0;
+}
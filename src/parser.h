@@ -0,0 +1,185 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "bytecode.h"
+
+// single pass precedence climbing (Pratt) parser, emitting bytecode straight from the lexer
+// it produces the same programs as compileExpr(), which is kept as the reference implementation, and parser.c checks both agree
+// the one difference is that a function name not followed by '(' is a syntax error here, while the shunting yard skips it
+typedef struct parser {
+	lexContext *ctx; // lexer context
+	tokenSpan span;	 // current token
+	program *prog;	 // program being emitted
+	int depth;		 // number of values on the stack at this point of the program
+} parser;
+
+int parseExpression(parser *p, int minPrecedence);
+
+// move to the next token
+int advance(parser *p) {
+	p->ctx->pType = p->span.type;
+	return nextSpan(p->ctx, &p->span);
+}
+
+// account for the values an instruction pushes and pops
+int adjustDepth(parser *p, int pops, int pushes) {
+	if (p->depth < pops) {
+		return ERROR_STACK_UNDERFLOW;
+	}
+	p->depth += pushes - pops;
+	if (p->depth > p->prog->depth) {
+		p->prog->depth = p->depth;
+	}
+	return ERROR_NONE;
+}
+
+// parse a comma separated list of expressions up to the closing token
+int parseList(parser *p, int closer) {
+	int error;
+	for (;;) {
+		if ((error = parseExpression(p, 1)) != ERROR_NONE) {
+			return error;
+		}
+		if (p->span.type == closer) {
+			return advance(p);
+		}
+		if (p->span.type != TOKEN_COMMA) {
+			return ERROR_SYNTAX;
+		}
+		if ((error = advance(p)) != ERROR_NONE) {
+			return error;
+		}
+	}
+}
+
+// parse a number, string, variable, function call, parenthesized list or unary
+int parsePrefix(parser *p) {
+	tokenSpan span = p->span;
+	unsigned char code;
+	int error;
+
+	switch (span.type) {
+	case TOKEN_NUMBER:
+		// numbers are stored inline with their decoded value
+		if (span.isFloat) {
+			if ((error = emitOp(p->prog, OP_FLOAT)) == ERROR_NONE) {
+				error = emitBytes(p->prog, &span.num.real, sizeof(double));
+			}
+		} else {
+			if ((error = emitOp(p->prog, OP_INT)) == ERROR_NONE) {
+				error = emitBytes(p->prog, &span.num.integer, sizeof(long));
+			}
+		}
+		if (error != ERROR_NONE || (error = adjustDepth(p, 0, 1)) != ERROR_NONE) {
+			return error;
+		}
+		return advance(p);
+	case TOKEN_STRING:
+	case TOKEN_VARIABLE:
+		// strings and variables reference their text in the expression
+		if ((error = emitSpan(p->prog, span.type == TOKEN_STRING ? OP_STRING : OP_VARIABLE, &span)) != ERROR_NONE) {
+			return error;
+		}
+		if ((error = adjustDepth(p, 0, 1)) != ERROR_NONE || (error = advance(p)) != ERROR_NONE) {
+			return error;
+		}
+		// variables may be followed by a list of indexes
+		if (span.type == TOKEN_VARIABLE && p->span.type == TOKEN_L_BRACKET) {
+			if ((error = advance(p)) != ERROR_NONE) {
+				return error;
+			}
+			return parseList(p, TOKEN_R_BRACKET);
+		}
+		return ERROR_NONE;
+	case TOKEN_FUNCTION:
+		// functions are not evaluated yet, only their arguments are
+		if ((error = advance(p)) != ERROR_NONE) {
+			return error;
+		}
+		if (p->span.type != TOKEN_L_PAREN) {
+			return ERROR_SYNTAX;
+		}
+		if ((error = advance(p)) != ERROR_NONE) {
+			return error;
+		}
+		return parseList(p, TOKEN_R_PAREN);
+	case TOKEN_L_PAREN:
+		if ((error = advance(p)) != ERROR_NONE) {
+			return error;
+		}
+		return parseList(p, TOKEN_R_PAREN);
+	case TOKEN_UNARY:
+		// unaries have the lowest precedence, so they apply to everything up to the end of the enclosing list
+		if ((code = opCodeTable[span.op]) == OP_END) {
+			return ERROR_UNKNOWN_OPERATOR;
+		}
+		if ((error = advance(p)) != ERROR_NONE || (error = parseExpression(p, 1)) != ERROR_NONE) {
+			return error;
+		}
+		if ((error = adjustDepth(p, 1, 1)) != ERROR_NONE) {
+			return error;
+		}
+		return emitOp(p->prog, code);
+	default:
+		return ERROR_SYNTAX;
+	}
+}
+
+// parse an expression made of operators with at least the given precedence
+int parseExpression(parser *p, int minPrecedence) {
+	unsigned char code;
+	int precedence;
+	int op;
+	int error;
+
+	if ((error = parsePrefix(p)) != ERROR_NONE) {
+		return error;
+	}
+	while (p->span.type == TOKEN_OPERATOR) {
+		if ((code = opCodeTable[p->span.op]) == OP_END) {
+			return ERROR_UNKNOWN_OPERATOR;
+		}
+		op = p->span.op;
+		if ((precedence = getPrecedence(op)) < minPrecedence) {
+			break;
+		}
+		if ((error = advance(p)) != ERROR_NONE) {
+			return error;
+		}
+		// the right operand of a left associative operator binds tighter
+		if ((error = parseExpression(p, isLeftAssociative(op) ? precedence + 1 : precedence)) != ERROR_NONE) {
+			return error;
+		}
+		if ((error = adjustDepth(p, 2, 1)) != ERROR_NONE || (error = emitOp(p->prog, code)) != ERROR_NONE) {
+			return error;
+		}
+	}
+	return ERROR_NONE;
+}
+
+// compile an expression into a program in a single pass
+int parseExpr(lexContext *ctx, program *prog) {
+	parser p;
+	int error;
+
+	initProgram(prog, ctx->expr);
+	prog->pool	= ctx->pool;
+	p.ctx		= ctx;
+	p.prog		= prog;
+	p.depth		= 0;
+	p.span.type = TOKEN_END;
+	if ((error = advance(&p)) == ERROR_NONE && p.span.type != TOKEN_END) {
+		if ((error = parseExpression(&p, 1)) == ERROR_NONE && p.span.type != TOKEN_END) {
+			error = ERROR_SYNTAX;
+		}
+	}
+	if (error == ERROR_NONE) {
+		error = emitOp(prog, OP_END);
+	}
+	if (error != ERROR_NONE) {
+		freeProgram(prog);
+	}
+	return error;
+}
+
+#endif
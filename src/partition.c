@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "orb.h"
+
+// largest number of variable names the churn test picks from
+#define CHURN_NAMES 250
+
+// default number of operations of the churn test
+#define CHURN_OPS 200000
+
+// number of variables the fill test adds
+#define FILL_VARS 20000
+
+// number of operations between two checks of all the variable values
+#define CHURN_CHECK 100
+
+// longest string value the churn test updates a variable to
+#define CHURN_STRING 40
+
+// names of the partition backends, a backend that isn't available falls back to the next one down
+static char *backendNames[] = {"malloc", "mmap", "hugepage", "hugetlb"};
+
+// value of each variable name, or -1 if the variable doesn't exist
+static int expected[CHURN_NAMES];
+
+// length of the string value of each variable name, or -1 if the variable holds an integer
+static int expectedLength[CHURN_NAMES];
+
+// number of variable names of the current churn test
+static int names;
+
+// function to set the partition size in the patch area, which alloc_partition reads it from
+static void set_patch_size(psize_t size) {
+    patch[6] = size % 256;
+    patch[7] = size / 256;
+}
+
+// function to get the name of a churn test variable
+static char *churn_name(char *name, int i) {
+    sprintf(name, "v%d", i);
+    return name;
+}
+
+// function to build the string value of a churn test variable from its value and length
+static char *churn_string(char *value, int n, int length) {
+    for (int k = 0; k < length; k++) {
+        value[k] = 'a' + (n + k) % 26;
+    }
+    value[length] = '\0';
+    return value;
+}
+
+// function to find a variable by walking the partition instead of looking it up in the index
+static char *scan_var(char *name) {
+    uint8_t size = strlen(name);
+    char *p = pStart;
+    while (p < pEnd) {
+        char *v = p + ELEMENT_HEADER_SIZE;
+        if (get_element_type(p) == 0x01 && (uint8_t)v[1] == size && memcmp(v + 2, name, size) == 0) {
+            return v;
+        }
+        p += get_element_size(p);
+    }
+    return NULL;
+}
+
+// function to check the index against the partition, returns an error message or NULL
+static char *check_index(void) {
+    psize_t live = 0, slots = 0, used = 0;
+    // every variable element is found through the index
+    char *p = pStart;
+    while (p < pEnd) {
+        if (get_element_type(p) == 0x01) {
+            char *v = p + ELEMENT_HEADER_SIZE;
+            psize_t *slot = find_slot(v + 2, v[1]);
+            if (slot == NULL || *slot != p - pStart + 1) {
+                return "variable missing from the index";
+            }
+            live++;
+        }
+        p += get_element_size(p);
+    }
+    if (p != pEnd) {
+        return "element sizes don't add up to the end of the partition";
+    }
+    // and the index holds nothing else
+    for (psize_t i = 0; i < iSize; i++) {
+        if (vIndex[i] != INDEX_EMPTY) {
+            used++;
+            if (vIndex[i] != INDEX_DELETED) {
+                slots++;
+            }
+        }
+    }
+    if (slots != live) {
+        return "index slots don't match the variable elements";
+    }
+    if (used != iUsed) {
+        return "index use count is wrong";
+    }
+    // the index is at most three quarters full, and no larger than the variables it held at the last rebuild need, plus
+    // the one it made room for, which may not have fitted the partition
+    if (iUsed > iSize / 4 * 3 || iSize > index_slots(iUsed + 1)) {
+        return "index is not sized for its variables";
+    }
+    return NULL;
+}
+
+// function to check the free lists against the deleted blocks in the partition, returns an error message or NULL
+static char *check_free_lists(void) {
+    psize_t linked = 0, blocks = 0;
+    // every block on a free list is a deleted block of the size class of the list, with a size footer and a back link
+    for (uint8_t c = 0; c < FREE_CLASSES; c++) {
+        psize_t prev = 0;
+        for (char *b = free_block(freeList[c]); b != NULL; b = free_block(*next_link(b))) {
+            if (b < pStart || b >= pEnd || (uint8_t)*b != 0xff) {
+                return "free list entry is not a deleted block";
+            }
+            psize_t size = get_element_size(b);
+            if (size < MIN_BLOCK_SIZE || size_class(size) != c) {
+                return "free list entry is in the wrong size class";
+            }
+            if (*((psize_t *)(b + size - sizeof(psize_t))) != size) {
+                return "free block has a wrong size footer";
+            }
+            if (*prev_link(b) != prev) {
+                return "free block has a wrong back link";
+            }
+            prev = b - pStart + 1;
+            if (++linked > pSize / MIN_BLOCK_SIZE) {
+                return "free list has a cycle";
+            }
+        }
+    }
+    // and every deleted block large enough to hold the links is on a free list
+    for (char *p = pStart; p < pEnd; p += get_element_size(p)) {
+        if ((uint8_t)*p == 0xff && get_element_size(p) >= MIN_BLOCK_SIZE) {
+            blocks++;
+        }
+    }
+    if (blocks != linked) {
+        return "deleted blocks are missing from the free lists";
+    }
+    return NULL;
+}
+
+// function to check that deleted blocks were merged with their neighbours and that the elements after them are flagged,
+// returns an error message or NULL
+static char *check_coalescing(void) {
+    bool prevLinked = false;
+    char *p = pStart;
+    // the empty area at the end is checked like a live element
+    for (;;) {
+        bool deleted = p < pEnd && (uint8_t)*p == 0xff;
+        bool linked = deleted && get_element_size(p) >= MIN_BLOCK_SIZE;
+        if (!deleted && ((*p & PREV_FREE) != 0) != prevLinked) {
+            return "element has a wrong PREV_FREE flag";
+        }
+        // a deleted element too small for the free lists can't be found from the block after it, so only it stays apart
+        if (deleted && prevLinked) {
+            return "deleted blocks next to each other were not merged";
+        }
+        if (p == pEnd) {
+            break;
+        }
+        prevLinked = linked;
+        p += get_element_size(p);
+    }
+    if (prevLinked) {
+        return "deleted block before the empty area was not merged into it";
+    }
+    return NULL;
+}
+
+// function to check the slack counter against the slack of the variable elements, returns an error message or NULL
+static char *check_slack(void) {
+    psize_t slack = 0;
+    for (char *p = pStart; p < pEnd; p += get_element_size(p)) {
+        if (get_element_type(p) == 0x01) {
+            slack += get_var_slack(p);
+        }
+    }
+    if (slack != get_slack()) {
+        return "slack counter doesn't match the variable elements";
+    }
+    return NULL;
+}
+
+// function to check a variable has its expected type and value, returns an error message or NULL
+static char *check_value(int i) {
+    char name[16];
+    char value[CHURN_STRING + 1];
+    char *v = find_var(churn_name(name, i));
+    if (v != scan_var(name)) {
+        return "index and partition disagree on a variable";
+    }
+    if ((v != NULL) != (expected[i] >= 0)) {
+        return "variable is missing or should not exist";
+    }
+    if (v == NULL) {
+        return NULL;
+    }
+    if (expectedLength[i] < 0) {
+        if (v[0] != 0x03 || get_var_int(v) != expected[i]) {
+            return "variable has a wrong value";
+        }
+    } else {
+        char *z = get_var_zstr(v);
+        churn_string(value, expected[i], expectedLength[i]);
+        if (v[0] != 0x05 || (uint8_t)z[0] != expectedLength[i] || memcmp(z + 1, value, expectedLength[i]) != 0) {
+            return "variable has a wrong string value";
+        }
+    }
+    return NULL;
+}
+
+// function to check every variable has its expected value, returns an error message or NULL
+static char *check_values(void) {
+    for (int i = 0; i < names; i++) {
+        char *error = check_value(i);
+        if (error != NULL) {
+            return error;
+        }
+    }
+    return NULL;
+}
+
+// function to run the churn test, adding, updating and deleting random variables, a missing variable is added with the
+// specified percentage, and an existing one updated to an integer or a string of random length with the other specified percentage
+// the index, the free lists, the merging of deleted blocks and the slack are checked after each change, the updated variable
+// after each update, which must keep its old value when it fails, and the values of all the variables every CHURN_CHECK changes
+// returns the number of failed checks
+static int churn(psize_t size, int count, int addPercent, int updatePercent, int ops) {
+    char name[16];
+    char value[CHURN_STRING + 1];
+    int failures = 0;
+    int updates = 0;
+    int fullUpdates = 0;
+
+    set_patch_size(size);
+    alloc_partition();
+    init_partition();
+    compactions = 0;
+    names = count;
+    for (int i = 0; i < names; i++) {
+        expected[i] = -1;
+    }
+
+    for (int n = 0; n < ops; n++) {
+        int i = rand() % names;
+        churn_name(name, i);
+        if (expected[i] < 0 && rand() % 100 < addPercent) {
+            // add the variable, a full partition keeps it out
+            load_int_var(vBuf1, name, n);
+            if (add_var(vBuf1) == 0) {
+                expected[i] = n;
+                expectedLength[i] = -1;
+            }
+        } else if (expected[i] >= 0 && rand() % 100 < updatePercent) {
+            // update the variable, one that doesn't fit and can't move keeps its old value
+            int length = rand() % (CHURN_STRING + 2) - 1;
+            uint8_t err = length < 0 ? update_int_var(name, n) : update_string_var(name, churn_string(value, n, length));
+            updates++;
+            if (err == 0) {
+                expected[i] = n;
+                expectedLength[i] = length;
+            } else if (err == 5) {
+                fullUpdates++;
+            } else {
+                failures++;
+            }
+        } else if (expected[i] >= 0) {
+            if (!delete_var(name)) {
+                failures++;
+            }
+            expected[i] = -1;
+        }
+        char *error = check_index();
+        if (error == NULL) {
+            error = check_free_lists();
+        }
+        if (error == NULL) {
+            error = check_coalescing();
+        }
+        if (error == NULL) {
+            error = check_slack();
+        }
+        if (error == NULL) {
+            error = check_value(i);
+        }
+        if (error == NULL && (n % CHURN_CHECK == 0 || n == ops - 1)) {
+            error = check_values();
+        }
+        if (error != NULL) {
+            if (failures++ < 10) {
+                printf("Error: %s after %d operations\n", error, n + 1);
+            }
+        }
+    }
+    printf("churn: %s backend, partition of %lu bytes, %d names, %d operations, %d updates, %d full, %lu compactions, %d failures\n", backendNames[pAllocBackend], (unsigned long)size, names, ops, updates, fullUpdates, compactions, failures);
+    free_partition();
+    return failures;
+}
+
+// function to run the fill test, adding variables to a partition of the default size until it's much larger than that
+// wide partitions must grow and keep all the variables, other partitions must report they're full and keep what they hold
+// returns the number of failed checks
+static int fill(void) {
+    char name[16];
+    int failures = 0;
+    int added = 0;
+    uint8_t err = 0;
+
+    set_patch_size(DEF_PARTITION_SIZE);
+    alloc_partition();
+    init_partition();
+    while (added < FILL_VARS && err == 0) {
+        sprintf(name, "g%d", added);
+        load_int_var(vBuf1, name, added);
+        if ((err = add_var(vBuf1)) == 0) {
+            added++;
+        }
+    }
+#ifdef WIDE_PARTITION
+    if (added != FILL_VARS) {
+        printf("Error: partition didn't grow\n");
+        failures++;
+    }
+#else
+    if (err != 5) {
+        printf("Error: full partition returned error %d\n", err);
+        failures++;
+    }
+#endif
+    // delete every third variable, then check the rest are still there
+    for (int i = 0; i < added; i += 3) {
+        sprintf(name, "g%d", i);
+        delete_var(name);
+    }
+    for (int i = 0; i < added; i++) {
+        sprintf(name, "g%d", i);
+        char *v = find_var(name);
+        if (i % 3 == 0 ? v != NULL : v == NULL || get_var_int(v) != i) {
+            failures++;
+        }
+    }
+    char *error = check_index();
+    if (error == NULL) {
+        error = check_free_lists();
+    }
+    if (error == NULL) {
+        error = check_coalescing();
+    }
+    if (error == NULL) {
+        error = check_slack();
+    }
+    if (error != NULL) {
+        printf("Error: %s after filling the partition\n", error);
+        failures++;
+    }
+    printf("fill: %s backend, %d variables, partition of %lu bytes, %d failures\n", backendNames[pAllocBackend], added, (unsigned long)pSize, failures);
+    free_partition();
+    return failures;
+}
+
+// main program
+// run the churn tests on each backend with the seed and the number of operations from the command line, returns 1 if any check failed
+int main(int argc, char *argv[]) {
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+    int ops = argc > 2 ? atoi(argv[2]) : CHURN_OPS;
+    int failures = 0;
+
+    for (uint8_t backend = BACKEND_MALLOC; backend <= BACKEND_HUGETLB; backend++) {
+        // prefault the huge page backends, the way they're meant to be used
+        set_partition_backend(backend, backend >= BACKEND_HUGEPAGE);
+        // the default partition, whose small index fills up with deleted slots and gets rebuilt often
+        failures += churn(DEF_PARTITION_SIZE, 60, 15, 30, ops);
+        // a larger partition, small enough to fill up and compact often, and for updates that don't fit to fail
+        failures += churn(2048, CHURN_NAMES, 100, 50, ops);
+        // a wide partition moves to a new allocation of the same backend as it grows
+        failures += fill();
+    }
+    return failures != 0;
+}
@@ -7,185 +7,207 @@
 #include <string.h>
 #include "token.h"
 
+// operator precedence, indexed by operator code
+// tokens which are not operators, like parentheses and functions, have precedence 0
+static const int opPrecedence[] = {
+	0, // OPR_NONE
+	0, // OPR_UNKNOWN
+	0, // OPR_NEG
+	0, // OPR_POS
+	0, // OPR_NOT
+	5, // OPR_POW
+	4, // OPR_MUL
+	4, // OPR_DIV
+	0, // OPR_MOD
+	3, // OPR_ADD
+	3, // OPR_SUB
+	2, // OPR_GT
+	2, // OPR_GE
+	2, // OPR_LT
+	2, // OPR_LE
+	2, // OPR_EQ
+	2, // OPR_NE
+	1  // OPR_ASSIGN
+};
+
+// operator associativity, indexed by operator code
+static const int opLeftAssociative[] = {
+	1, // OPR_NONE
+	1, // OPR_UNKNOWN
+	0, // OPR_NEG
+	1, // OPR_POS
+	1, // OPR_NOT
+	0, // OPR_POW
+	1, // OPR_MUL
+	1, // OPR_DIV
+	1, // OPR_MOD
+	1, // OPR_ADD
+	1, // OPR_SUB
+	1, // OPR_GT
+	1, // OPR_GE
+	1, // OPR_LT
+	1, // OPR_LE
+	1, // OPR_EQ
+	1, // OPR_NE
+	1  // OPR_ASSIGN
+};
+
 // return the operator precedence
-int getPrecedence(char *op) {
-	if (strcmp(op, "^") == 0) {
-		return 5;
-	} else if (strcmp(op, "*") == 0 || strcmp(op, "/") == 0) {
-		return 4;
-	} else if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0) {
-		return 3;
-	} else if (strcmp(op, ">") == 0 || strcmp(op, ">=") == 0 || strcmp(op, "<") == 0 || strcmp(op, "<=") == 0 || strcmp(op, "==") == 0 || strcmp(op, "!=") == 0) {
-		return 2;
-	} else if (strcmp(op, "=") == 0) {
-		return 1;
-	} else {
-		return 0;
-	}
+int getPrecedence(int op) {
+	return opPrecedence[op];
 }
 
 // return true if the operator is left associative
-int isLeftAssociative(char *op) {
-	if (strcmp(op, "^") == 0) {
-		return 0;
-	} else if (strcmp(op, "-u") == 0) {
-		return 0;
-	} else {
-		return 1;
+int isLeftAssociative(int op) {
+	return opLeftAssociative[op];
+}
+
+// pop operators into the output until the top of the operator stack has the given type
+int popOperatorsUntil(tokenVector *operatorStack, tokenVector *tokens, int type1, int type2) {
+	tokenSpan top;
+	int error;
+	while (operatorStack->count > 0 && topSpan(operatorStack)->type != type1 && topSpan(operatorStack)->type != type2) {
+		popSpan(operatorStack, &top);
+		if ((error = appendSpan(tokens, &top)) != ERROR_NONE) {
+			return error;
+		}
 	}
+	return ERROR_NONE;
 }
 
-// convert an infix expression to a postfix tokens list
-int infixToPostfix(char *expr, tokenStack **tokens) {
-	// define a stack for operators
-	tokenStack *operatorStack = NULL;
-	// define a token buffer
-	char token[MAX_TOKEN_LENGTH];
-	// define a token type
-	int type  = TOKEN_END;
-	// define a token buffer for the top of the operator stack
-	char topToken[MAX_TOKEN_LENGTH];
-	// define a token type for the top of the operator stack
-	int topType = TOKEN_END;
+// run the shunting yard over the expression, using the given operator stack
+int shuntingYard(lexContext *ctx, tokenVector *tokens, tokenVector *operatorStack) {
+	// define the current token
+	tokenSpan span;
+	// define the token at the top of the operator stack
+	tokenSpan top;
+	int precedence;
 
 	// define an error code
 	int error = 0;
 
 	// read the expression from left to right for a token
-	while ((error = nextToken(expr, token, &type)) == ERROR_NONE && type != TOKEN_END) {
+	while ((error = nextSpan(ctx, &span)) == ERROR_NONE && span.type != TOKEN_END) {
 		// if the token is a number, a string or a variable, append it to the output list
-		if (type == TOKEN_NUMBER || type == TOKEN_STRING || type == TOKEN_VARIABLE) {
-			if ((error = appendToken(tokens, token, type)) != ERROR_NONE) {
+		if (span.type == TOKEN_NUMBER || span.type == TOKEN_STRING || span.type == TOKEN_VARIABLE) {
+			if ((error = appendSpan(tokens, &span)) != ERROR_NONE) {
 				return error;
 			}
 		}
 		// if the token is a function or an unary, push it onto the operator stack
-		else if (type == TOKEN_FUNCTION || type == TOKEN_UNARY) {
-			if ((error = pushToken(&operatorStack, token, type)) != ERROR_NONE) {
+		else if (span.type == TOKEN_FUNCTION || span.type == TOKEN_UNARY) {
+			if ((error = appendSpan(operatorStack, &span)) != ERROR_NONE) {
 				return error;
 			}
 		}
 		// if the token is an operator
-		else if (type == TOKEN_OPERATOR) {
+		else if (span.type == TOKEN_OPERATOR) {
+			precedence = getPrecedence(span.op);
 			// while the operator at the top of the operator stack has greater precedence than the token or the operator at the top of the operator stack is left associative and has equal precedence to the token
-			while (operatorStack != NULL && (getPrecedence(operatorStack->token) > getPrecedence(token) || (getPrecedence(operatorStack->token) == getPrecedence(token) && isLeftAssociative(operatorStack->token)))) {
-				if ((error = popToken(&operatorStack, topToken, &topType)) != ERROR_NONE) {
-					return error;
-				}
-				if ((error = appendToken(tokens, topToken, topType)) != ERROR_NONE) {
+			while (operatorStack->count > 0 && (getPrecedence(topSpan(operatorStack)->op) > precedence || (getPrecedence(topSpan(operatorStack)->op) == precedence && isLeftAssociative(topSpan(operatorStack)->op)))) {
+				popSpan(operatorStack, &top);
+				if ((error = appendSpan(tokens, &top)) != ERROR_NONE) {
 					return error;
 				}
 			}
 			// push the new token onto the operator stack
-			if ((error = pushToken(&operatorStack, token, type)) != ERROR_NONE) {
+			if ((error = appendSpan(operatorStack, &span)) != ERROR_NONE) {
 				return error;
 			}
 		}
 		// if the token is a left parenthesis, push it onto the operator stack
-		else if (type == TOKEN_L_PAREN) {
-			if ((error = pushToken(&operatorStack, token, type)) != ERROR_NONE) {
+		else if (span.type == TOKEN_L_PAREN) {
+			if ((error = appendSpan(operatorStack, &span)) != ERROR_NONE) {
 				return error;
 			}
-			pLevel++;
+			ctx->pLevel++;
 		}
 		// if the token is a right parenthesis
-		else if (type == TOKEN_R_PAREN) {
-			// while the operator at the top of the operator stack is not a left parenthesis pop the operator from the operator stack and append it to the output list
-			while (operatorStack != NULL && operatorStack->type != TOKEN_L_PAREN) {
-				if ((error = popToken(&operatorStack, topToken, &topType)) != ERROR_NONE) {
-					return error;
-				}
-				if ((error = appendToken(tokens, topToken, topType)) != ERROR_NONE) {
-					return error;
-				}
+		else if (span.type == TOKEN_R_PAREN) {
+			// pop the operators from the operator stack and append them to the output list until a left parenthesis is found
+			if ((error = popOperatorsUntil(operatorStack, tokens, TOKEN_L_PAREN, TOKEN_L_PAREN)) != ERROR_NONE) {
+				return error;
 			}
-			if (operatorStack == NULL) {
+			if (operatorStack->count == 0) {
 				return ERROR_SYNTAX;
 			}
-			if ((error = popToken(&operatorStack, topToken, &topType)) != ERROR_NONE) {
-				return error;
-			}
+			popSpan(operatorStack, &top);
 			// if the operator at the top of the operator stack is a function, pop the operator from the operator stack and append it to the output list
-			if (operatorStack != NULL && topType == TOKEN_FUNCTION) {
-				if ((error = popToken(&operatorStack, topToken, &topType)) != ERROR_NONE) {
-					return error;
-				}
-				if ((error = appendToken(tokens, topToken, topType)) != ERROR_NONE) {
+			if (operatorStack->count > 0 && topSpan(operatorStack)->type == TOKEN_FUNCTION) {
+				popSpan(operatorStack, &top);
+				if ((error = appendSpan(tokens, &top)) != ERROR_NONE) {
 					return error;
 				}
 			}
-			pLevel--;
+			ctx->pLevel--;
 		}
 		// if the token is a left bracket push it onto the operator stack
-		else if (type == TOKEN_L_BRACKET) {
-			if ((error = pushToken(&operatorStack, token, type)) != ERROR_NONE) {
+		else if (span.type == TOKEN_L_BRACKET) {
+			if ((error = appendSpan(operatorStack, &span)) != ERROR_NONE) {
 				return error;
 			}
-			bLevel++;
-			if ((error = appendToken(tokens, token, type)) != ERROR_NONE) {
+			ctx->bLevel++;
+			if ((error = appendSpan(tokens, &span)) != ERROR_NONE) {
 				return error;
 			}
 		}
 		// if the token is a right bracket
-		else if (type == TOKEN_R_BRACKET) {
-			// while the operator at the top of the operator stack is not a left bracket pop the operator from the operator stack and append it to the output list
-			while (operatorStack != NULL && operatorStack->type != TOKEN_L_BRACKET) {
-				if ((error = popToken(&operatorStack, topToken, &topType)) != ERROR_NONE) {
-					return error;
-				}
-				if ((error = appendToken(tokens, topToken, topType)) != ERROR_NONE) {
-					return error;
-				}
+		else if (span.type == TOKEN_R_BRACKET) {
+			// pop the operators from the operator stack and append them to the output list until a left bracket is found
+			if ((error = popOperatorsUntil(operatorStack, tokens, TOKEN_L_BRACKET, TOKEN_L_BRACKET)) != ERROR_NONE) {
+				return error;
 			}
-			if (operatorStack == NULL) {
+			if (operatorStack->count == 0) {
 				return ERROR_SYNTAX;
 			}
-			if ((error = appendToken(tokens, token, type)) != ERROR_NONE) {
+			if ((error = appendSpan(tokens, &span)) != ERROR_NONE) {
 				return error;
 			}
-			if ((error = popToken(&operatorStack, token, &type)) != ERROR_NONE) {
-				return error;
-			}
-			bLevel--;
+			popSpan(operatorStack, &top);
+			ctx->bLevel--;
 		}
 
 		// if the token is a comma
-		else if (type == TOKEN_COMMA) {
-			// while the operator at the top of the operator stack is not a left parenthesis or a left bracket pop the operator from the operator stack and append it to the output list
-			while (operatorStack != NULL && operatorStack->type != TOKEN_L_PAREN && operatorStack->type != TOKEN_L_BRACKET) {
-				if ((error = popToken(&operatorStack, topToken, &topType)) != ERROR_NONE) {
-					return error;
-				}
-				if ((error = appendToken(tokens, topToken, topType)) != ERROR_NONE) {
-					return error;
-				}
+		else if (span.type == TOKEN_COMMA) {
+			// pop the operators from the operator stack and append them to the output list until a left parenthesis or a left bracket is found
+			if ((error = popOperatorsUntil(operatorStack, tokens, TOKEN_L_PAREN, TOKEN_L_BRACKET)) != ERROR_NONE) {
+				return error;
 			}
-			if (operatorStack == NULL) {
+			if (operatorStack->count == 0) {
 				return ERROR_SYNTAX;
 			}
 		}
-		pType = type;
+		ctx->pType = span.type;
 	}
 	if (error != ERROR_NONE) {
 		return error;
 	}
-	if (pLevel != 0) {
+	if (ctx->pLevel != 0) {
 		return ERROR_SYNTAX;
 	}
-	if (bLevel != 0) {
+	if (ctx->bLevel != 0) {
 		return ERROR_SYNTAX;
 	}
-	// while there are still operators on the operator stack, pop the operator from the operator stack and append it to the output string
-	while (operatorStack != NULL) {
-		if ((error = popToken(&operatorStack, topToken, &topType)) != ERROR_NONE) {
-			return error;
-		}
-		if ((error = appendToken(tokens, topToken, topType)) != ERROR_NONE) {
+	// while there are still operators on the operator stack, pop the operator from the operator stack and append it to the output list
+	while (popSpan(operatorStack, &top) == ERROR_NONE) {
+		if ((error = appendSpan(tokens, &top)) != ERROR_NONE) {
 			return error;
 		}
 	}
-
 	return ERROR_NONE;
 }
 
+// convert an infix expression to a postfix tokens vector
+int infixToPostfix(lexContext *ctx, tokenVector *tokens) {
+	// define a stack for operators, released on every path
+	tokenVector operatorStack;
+	int error;
+
+	initVector(&operatorStack);
+	operatorStack.pool = ctx->pool;
+	error			   = shuntingYard(ctx, tokens, &operatorStack);
+	freeVector(&operatorStack);
+	return error;
+}
+
 #endif
\ No newline at end of file
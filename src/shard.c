@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "shard.h"
+
+// default number of threads and of operations each thread runs
+#define DEF_THREADS 8
+#define DEF_OPS 200000
+
+// partition size of each shard
+#define SHARD_PARTITION_SIZE 4096
+
+// number of variable names each thread owns, and of names all the threads change
+#define OWN_NAMES 64
+#define COMMON_NAMES 32
+
+// longest string value of a variable
+#define SHARD_STRING 20
+
+// store all the threads work on
+static shard_store store;
+
+// number of operations each thread runs
+static int ops = DEF_OPS;
+
+// function to build the string value of a variable from a number and a length
+static char *var_string(char *value, int n, int length) {
+    for (int i = 0; i < length; i++) {
+        value[i] = 'a' + (n + i) % 26;
+    }
+    value[length] = '\0';
+    return value;
+}
+
+// function to check a variable holds the integer or the string made from a number, a negative length for an integer
+static bool check_var(char *vBuf, int n, int length) {
+    char value[SHARD_STRING + 1];
+    if (length < 0) {
+        return get_var_type(vBuf) == 0x03 && get_var_int(vBuf) == n;
+    }
+    char *z = get_var_zstr(vBuf);
+    return get_var_type(vBuf) == 0x05 && (uint8_t)z[0] == length && memcmp(z + 1, var_string(value, n, length), length) == 0;
+}
+
+// function to check a common variable holds a value some thread made for it, integers are its number plus a multiple of COMMON_NAMES
+static bool check_common(char *vBuf, int k) {
+    if (get_var_type(vBuf) == 0x03) {
+        return get_var_int(vBuf) % COMMON_NAMES == k;
+    }
+    char *z = get_var_zstr(vBuf);
+    return get_var_type(vBuf) == 0x05 && (uint8_t)z[0] <= SHARD_STRING && check_var(vBuf, k, (uint8_t)z[0]);
+}
+
+// thread body, adds, updates, deletes and finds the variables the thread owns, whose values it knows, and updates and
+// finds the common ones, whose values must be ones some thread made for them
+// returns the number of failed checks
+static void *work(void *arg) {
+    int t = (int)(long)arg;
+    unsigned long seed = t + 1;
+    long mismatches = 0;
+    char name[16];
+    char value[SHARD_STRING + 1];
+    char vBuf[3 + 255 + 255];
+
+    // value and string length of each variable the thread owns, a value of -1 if it doesn't exist
+    int expected[OWN_NAMES];
+    int expectedLength[OWN_NAMES];
+
+    for (int i = 0; i < OWN_NAMES; i++) {
+        expected[i] = -1;
+    }
+    for (int n = 0; n < ops; n++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned int r = seed >> 16;
+        int i = r % OWN_NAMES;
+        int length = (int)((r >> 8) % (SHARD_STRING + 2)) - 1;
+        uint8_t err;
+        sprintf(name, "t%dv%d", t, i);
+        switch (r % 5) {
+        case 0:
+            // add the variable if it's missing, add_var doesn't look for an existing one
+            if (expected[i] < 0) {
+                load_int_var(vBuf, name, n);
+                err = shard_add_var(&store, vBuf);
+                if (err == 0) {
+                    expected[i] = n;
+                    expectedLength[i] = -1;
+                } else if (err != 5) {
+                    mismatches++;
+                }
+            }
+            break;
+        case 1:
+            // set the variable to an integer or a string, one that doesn't fit keeps its old value
+            err = length < 0 ? shard_update_var(&store, 0x03, name, sizeof(int), (char *)&n)
+                : shard_update_var(&store, 0x05, name, length, var_string(value, n, length));
+            if (err == 0) {
+                expected[i] = n;
+                expectedLength[i] = length;
+            } else if (err != 5) {
+                mismatches++;
+            }
+            break;
+        case 2:
+            if (shard_delete_var(&store, name) != (expected[i] >= 0)) {
+                mismatches++;
+            }
+            expected[i] = -1;
+            break;
+        case 3:
+            // change a common variable, which all the threads change
+            i %= COMMON_NAMES;
+            sprintf(name, "c%d", i);
+            if (length < 0) {
+                int v = i + COMMON_NAMES * n;
+                shard_update_var(&store, 0x03, name, sizeof(int), (char *)&v);
+            } else {
+                shard_update_var(&store, 0x05, name, length, var_string(value, i, length));
+            }
+            if (shard_find_var(&store, name, vBuf) && !check_common(vBuf, i)) {
+                mismatches++;
+            }
+            break;
+        }
+        // find the variable the thread owns, which no other thread changes
+        sprintf(name, "t%dv%d", t, i);
+        bool found = shard_find_var(&store, name, vBuf);
+        if (found != (expected[i] >= 0) || (found && !check_var(vBuf, expected[i], expectedLength[i]))) {
+            mismatches++;
+        }
+    }
+    return (void *)mismatches;
+}
+
+// function to check each variable of the store is in the shard its name hashes to, returns the number of misplaced variables
+static long check_shards(long *vars) {
+    partition_state saved;
+    long misplaced = 0;
+    save_partition_state(&saved);
+    for (int i = 0; i < store.count; i++) {
+        use_partition_state(&store.shards[i].state);
+        for (char *p = pStart; p < pEnd; p += get_element_size(p)) {
+            char *v = p + ELEMENT_HEADER_SIZE;
+            if (get_element_type(p) == 0x01) {
+                (*vars)++;
+                if (shard_of(&store, v + 2, v[1]) != &store.shards[i]) {
+                    misplaced++;
+                }
+            }
+        }
+    }
+    use_partition_state(&saved);
+    return misplaced;
+}
+
+// main program
+// run the threads on a sharded store, then check where the variables ended up, returns 1 if any check failed
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : DEF_THREADS;
+    long mismatches = 0;
+    long vars = 0;
+    pthread_t *ids;
+    void *result;
+
+    if (argc > 2) {
+        ops = atoi(argv[2]);
+    }
+    if (threads < 1 || ops < 1) {
+        printf("Usage: shard [threads] [operations]\n");
+        return 1;
+    }
+    patch[6] = SHARD_PARTITION_SIZE % 256;
+    patch[7] = SHARD_PARTITION_SIZE / 256;
+    if (!shard_init(&store, DEF_SHARD_COUNT)) {
+        return 1;
+    }
+    ids = malloc(threads * sizeof(pthread_t));
+    if (ids == NULL) {
+        return 1;
+    }
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&ids[i], NULL, work, (void *)(long)i) != 0) {
+            printf("Error: could not start thread %d\n", i);
+            return 1;
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], &result);
+        mismatches += (long)result;
+    }
+    free(ids);
+    mismatches += check_shards(&vars);
+    printf("%d threads, %ld operations, %d shards, %ld variables left, %ld mismatches\n", threads, (long)threads * ops, store.count, vars, mismatches);
+    shard_free(&store);
+    return mismatches != 0;
+}
@@ -0,0 +1,152 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+// Sharded variable store for multi-threaded hosts.
+//
+// Variable names are hashed across a number of independent partitions (shards), each one with its own lock,
+// index, free lists and compaction, so threads working on different shards never wait for each other.
+// Lookups take the shard lock for reading, so they only wait for a writer of the same shard.
+//
+// The partition functions work on the current partition of the calling thread, so orb.h is built with
+// THREAD_LOCAL_PARTITION: a shard operation saves the thread's partition, switches to the shard, runs the
+// partition function and switches back.
+
+#ifndef THREAD_LOCAL_PARTITION
+#ifdef ORB_H
+#error "shard.h must be included before orb.h, or orb.h built with THREAD_LOCAL_PARTITION"
+#endif
+#define THREAD_LOCAL_PARTITION
+#endif
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "orb.h"
+
+//---------- constants ----------
+
+#define DEF_SHARD_COUNT 16
+
+//---------- custom types ----------
+
+// shard of the store
+typedef struct shard {
+    pthread_rwlock_t lock;      // taken for writing by add and delete, for reading by lookups
+    partition_state state;      // partition of the shard
+} shard;
+
+// sharded variable store
+typedef struct shard_store {
+    int count;                  // number of shards
+    shard *shards;
+} shard_store;
+
+//---------- shard functions ----------
+
+// function to get the shard a variable name belongs to
+static inline shard *shard_of(shard_store *store, char *name, uint8_t size) {
+    // spread the high bits of the name hash over the shards, the index of each shard uses the low bits
+    uint32_t hash = name_hash(name, size) * 2654435761u;
+    return &store->shards[((unsigned long long)hash * store->count) >> 32];
+}
+
+// function to create a store of the specified number of shards, each one a partition of the patch area size
+static inline bool shard_init(shard_store *store, int count) {
+    partition_state saved;
+    if ((store->shards = malloc(count * sizeof(shard))) == NULL) {
+        printf("Error: could not allocate %d shards\n", count);
+        return false;
+    }
+    store->count = count;
+    save_partition_state(&saved);
+    for (int i = 0; i < count; i++) {
+        pthread_rwlock_init(&store->shards[i].lock, NULL);
+        // allocate the partition of the shard through the thread's partition variables, starting from a clear state
+        memset(&store->shards[i].state, 0, sizeof(partition_state));
+        use_partition_state(&store->shards[i].state);
+        alloc_partition();
+        init_partition();
+        save_partition_state(&store->shards[i].state);
+    }
+    use_partition_state(&saved);
+    return true;
+}
+
+// function to free a store
+static inline void shard_free(shard_store *store) {
+    partition_state saved;
+    save_partition_state(&saved);
+    for (int i = 0; i < store->count; i++) {
+        use_partition_state(&store->shards[i].state);
+        free_partition();
+        pthread_rwlock_destroy(&store->shards[i].lock);
+    }
+    use_partition_state(&saved);
+    free(store->shards);
+    store->shards = NULL;
+    store->count = 0;
+}
+
+// function to add a variable loaded into a variable buffer to its shard, returns the add_var error code
+static inline uint8_t shard_add_var(shard_store *store, char *v) {
+    partition_state saved;
+    shard *s = shard_of(store, v + 2, v[1]);
+    pthread_rwlock_wrlock(&s->lock);
+    save_partition_state(&saved);
+    use_partition_state(&s->state);
+    uint8_t err = add_var(v);
+    save_partition_state(&s->state);
+    use_partition_state(&saved);
+    pthread_rwlock_unlock(&s->lock);
+    return err;
+}
+
+// function to set the value of a variable in its shard, adding it if it doesn't exist, returns the update_var error code
+static inline uint8_t shard_update_var(shard_store *store, char type, char *name, uint8_t size, char *value) {
+    partition_state saved;
+    shard *s = shard_of(store, name, strlen(name));
+    pthread_rwlock_wrlock(&s->lock);
+    save_partition_state(&saved);
+    use_partition_state(&s->state);
+    uint8_t err = update_var(type, name, size, value);
+    save_partition_state(&s->state);
+    use_partition_state(&saved);
+    pthread_rwlock_unlock(&s->lock);
+    return err;
+}
+
+// function to delete a variable from its shard
+static inline bool shard_delete_var(shard_store *store, char *name) {
+    partition_state saved;
+    shard *s = shard_of(store, name, strlen(name));
+    pthread_rwlock_wrlock(&s->lock);
+    save_partition_state(&saved);
+    use_partition_state(&s->state);
+    bool found = delete_var(name);
+    save_partition_state(&s->state);
+    use_partition_state(&saved);
+    pthread_rwlock_unlock(&s->lock);
+    return found;
+}
+
+// function to find a variable in its shard and copy it into a variable buffer, returns false if not found
+static inline bool shard_find_var(shard_store *store, char *name, char *vBuf) {
+    partition_state saved;
+    shard *s = shard_of(store, name, strlen(name));
+    pthread_rwlock_rdlock(&s->lock);
+    save_partition_state(&saved);
+    use_partition_state(&s->state);
+    char *v = find_var(name);
+    if (v != NULL) {
+        memcpy(vBuf, v, get_var_size(v));
+    }
+    use_partition_state(&saved);
+    pthread_rwlock_unlock(&s->lock);
+    return v != NULL;
+}
+
+#endif
@@ -0,0 +1,301 @@
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "shared.h"
+
+// default number of reader processes and of changes the writer makes
+#define DEF_READERS 4
+#define DEF_CHANGES 100000
+
+// partition size of the shared segment, small enough for the writer to compact it while the readers look variables up
+#define SHARED_PARTITION_SIZE 5000
+
+// number of variable names the writer changes
+#define SHARED_NAMES 200
+
+// longest string value of a variable
+#define SHARED_STRING 40
+
+// longest time a reader may take to give up on a dead writer, in milliseconds
+#define DEAD_WRITER_MS 100
+
+// function to get the name of a variable the writer changes
+static char *var_name(char *name, int k) {
+    sprintf(name, "k%d", k);
+    return name;
+}
+
+// function to build the string value of a variable from its number, the change number and the length
+// the first letter comes from the variable number and the others from the change number, so a lookup which mixes two
+// values of the variable sees different letters after the first one
+static char *var_string(char *value, int k, int n, int length) {
+    for (int i = 0; i < length; i++) {
+        value[i] = 'a' + (i == 0 ? k : n) % 26;
+    }
+    value[length] = '\0';
+    return value;
+}
+
+// function to check a variable holds a value the writer makes for its number, returns false if it doesn't
+// integers are the number plus a multiple of SHARED_NAMES, strings come from var_string
+static bool check_var(char *vBuf, int k) {
+    char *z = get_var_zstr(vBuf);
+    uint8_t length = z[0];
+    if (get_var_type(vBuf) == 0x03) {
+        return length == sizeof(int) && get_var_int(vBuf) % SHARED_NAMES == k;
+    }
+    if (get_var_type(vBuf) != 0x05 || length > SHARED_STRING || (length > 0 && z[1] != 'a' + k % 26)) {
+        return false;
+    }
+    for (int i = 2; i < length; i++) {
+        if (z[i + 1] != z[2]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// function to check the hot variable, which the writer overwrites in place with a string of one letter after each change
+static bool check_hot(char *vBuf) {
+    char *z = get_var_zstr(vBuf);
+    if (get_var_type(vBuf) != 0x05 || (uint8_t)z[0] != SHARED_STRING) {
+        return false;
+    }
+    for (int i = 1; i < SHARED_STRING; i++) {
+        if (z[i + 1] != z[1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// function to get the time in milliseconds
+static long milliseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+// reader process body, looks variables up until the writer adds the done variable
+// the first reader must fail to take the segment over from the writer, the change counter must always be found and never go back, the hot variable must never be seen half overwritten, the
+// other variables must hold values the writer makes for them, and a buffer too small for a variable must make the lookup fail
+// returns the number of failed checks
+static long reader(char *segment, int r) {
+    shared_segment seg;
+    unsigned long seed = r + 1;
+    long mismatches = 0;
+    long lookups = 0;
+    int last = 0;
+    char name[16];
+    char vBuf[3 + 255 + 255];
+
+    if (shared_attach(&seg, segment) != 0) {
+        return 1;
+    }
+    // the writer is alive, so the segment can't be taken over
+    if (r == 0 && shared_create(segment, SHARED_PARTITION_SIZE) == 0) {
+        printf("Error: segment taken over from a live writer\n");
+        mismatches++;
+    }
+    if (shared_find_var(&seg, "changes", vBuf, sizeof(int))) {
+        printf("Error: variable copied into a buffer too small for it\n");
+        mismatches++;
+    }
+    while (!shared_find_var(&seg, "done", vBuf, sizeof(vBuf))) {
+        if (!shared_find_var(&seg, "changes", vBuf, sizeof(vBuf)) || get_var_int(vBuf) < last) {
+            mismatches++;
+        } else {
+            last = get_var_int(vBuf);
+        }
+        if (!shared_find_var(&seg, "hot", vBuf, sizeof(vBuf)) || !check_hot(vBuf)) {
+            mismatches++;
+        }
+        seed = seed * 1103515245 + 12345;
+        int k = (seed >> 16) % SHARED_NAMES;
+        if (shared_find_var(&seg, var_name(name, k), vBuf, sizeof(vBuf)) && !check_var(vBuf, k)) {
+            mismatches++;
+        }
+        lookups++;
+    }
+    printf("reader %d: %ld lookups, %ld mismatches\n", r, lookups, mismatches);
+    shared_detach(&seg);
+    return mismatches;
+}
+
+// function to check a reader gives up quickly on a segment whose writer died in the middle of a change
+// returns the number of failed checks
+static long dead_writer(char *segment) {
+    shared_segment seg;
+    char vBuf[3 + 255 + 255];
+    int status;
+
+    shared_unlink(segment);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        // the writer starts a change and never finishes it
+        if (shared_create(segment, SHARED_PARTITION_SIZE) != 0) {
+            _exit(1);
+        }
+        load_int_var(vBuf, "a", 1);
+        shared_add_var(vBuf);
+        shared_begin_write((shared_header *)pMap);
+        _exit(0);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0
+        || shared_attach(&seg, segment) != 0) {
+        printf("Error: could not set up the dead writer segment\n");
+        return 1;
+    }
+    long start = milliseconds();
+    bool found = shared_find_var(&seg, "a", vBuf, sizeof(vBuf));
+    long elapsed = milliseconds() - start;
+    printf("dead writer: found %d after %ldms\n", found, elapsed);
+    shared_detach(&seg);
+    shared_unlink(segment);
+    return found || elapsed > DEAD_WRITER_MS;
+}
+
+// writer process body, changes a shared partition while reader processes look variables up
+// returns the number of failed checks
+static long writer(char *segment, int readers, int changes) {
+    long mismatches = 0;
+    char name[16];
+    char value[SHARED_STRING + 1];
+    char vBuf[3 + 255 + 255];
+    int status;
+
+    if (shared_create(segment, SHARED_PARTITION_SIZE) != 0) {
+        return 1;
+    }
+    for (int k = 0; k < SHARED_NAMES; k++) {
+        shared_update_var(0x03, var_name(name, k), sizeof(int), (char *)&k);
+    }
+    int count = 0;
+    shared_update_var(0x03, "changes", sizeof(int), (char *)&count);
+    memset(value, 'a', SHARED_STRING);
+    shared_update_var(0x05, "hot", SHARED_STRING, value);
+    fflush(stdout);
+    for (int r = 0; r < readers; r++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            long failed = reader(segment, r);
+            fflush(stdout);
+            _exit(failed != 0);
+        }
+        if (pid < 0) {
+            printf("Error: could not start reader %d\n", r);
+            return 1;
+        }
+    }
+
+    // change random variables, counting the changes, then tell the readers to stop
+    for (int n = 1; n <= changes; n++) {
+        int k = rand() % SHARED_NAMES;
+        int v = k + SHARED_NAMES * n;
+        var_name(name, k);
+        switch (rand() % 3) {
+        case 0:
+            shared_update_var(0x03, name, sizeof(int), (char *)&v);
+            break;
+        case 1:
+            var_string(value, k, n, rand() % (SHARED_STRING + 1));
+            shared_update_var(0x05, name, strlen(value), value);
+            break;
+        default:
+            shared_delete_var(name);
+        }
+        shared_update_var(0x03, "changes", sizeof(int), (char *)&n);
+        memset(value, 'a' + n % 26, SHARED_STRING);
+        shared_update_var(0x05, "hot", SHARED_STRING, value);
+    }
+    load_int_var(vBuf, "done", 1);
+    shared_add_var(vBuf);
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            mismatches++;
+        }
+    }
+    printf("writer: %d changes, %lu compactions\n", changes, compactions);
+    return mismatches;
+}
+
+// function to take the segment over once its writer is gone, it must hold the variables, the slack and the free lists
+// the writer left, returns the number of failed checks
+static long take_over(char *segment) {
+    shared_segment seg;
+    long mismatches = 0;
+    char name[16];
+    char vBuf[3 + 255 + 255];
+
+    // copy of each variable the writer left
+    static char left[SHARED_NAMES][3 + 16 + 255];
+
+    if (shared_attach(&seg, segment) != 0) {
+        return 1;
+    }
+    psize_t slack = seg.h->slack;
+    for (int k = 0; k < SHARED_NAMES; k++) {
+        left[k][0] = shared_find_var(&seg, var_name(name, k), left[k] + 1, sizeof(left[k]) - 1);
+    }
+    shared_detach(&seg);
+    if (shared_create(segment, SHARED_PARTITION_SIZE) != 0) {
+        return 1;
+    }
+    int kept = 0;
+    for (int k = 0; k < SHARED_NAMES; k++) {
+        char *v = find_var(var_name(name, k));
+        if ((v != NULL) != left[k][0] || (v != NULL && memcmp(v, left[k] + 1, get_var_size(v)) != 0)) {
+            mismatches++;
+        }
+        kept += v != NULL;
+    }
+    if (get_slack() != slack) {
+        mismatches++;
+    }
+    load_int_var(vBuf, "extra", 1);
+    if (shared_add_var(vBuf) != 0 || !shared_delete_var("extra")) {
+        mismatches++;
+    }
+    printf("take over: %d variables kept\n", kept);
+    free_partition();
+    shared_unlink(segment);
+    return mismatches;
+}
+
+// main program
+// change a shared partition in a writer process while reader processes look variables up, take the segment over once the
+// writer is gone, then check the readers give up on a dead writer, returns 1 if any check failed
+int main(int argc, char *argv[]) {
+    int readers = argc > 1 ? atoi(argv[1]) : DEF_READERS;
+    int changes = argc > 2 ? atoi(argv[2]) : DEF_CHANGES;
+    long mismatches = 0;
+    char segment[32];
+    int status;
+
+    if (readers < 1 || changes < 1) {
+        printf("Usage: shared [readers] [changes]\n");
+        return 1;
+    }
+    sprintf(segment, "/orb%d", (int)getpid());
+    shared_unlink(segment);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        long failed = writer(segment, readers, changes);
+        fflush(stdout);
+        _exit(failed != 0);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        mismatches++;
+    }
+
+    mismatches += take_over(segment);
+    mismatches += dead_writer(segment);
+    printf("%ld mismatches\n", mismatches);
+    return mismatches != 0;
+}
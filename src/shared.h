@@ -0,0 +1,330 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+// Partition in POSIX shared memory, shared by a pool of processes.
+//
+// One designated process creates the segment with shared_create, which makes it its current partition, and
+// changes it with shared_add_var/shared_update_var/shared_delete_var. Another process can only take the segment over
+// once that writer is gone. The other processes attach to the segment read-only and
+// look variables up with shared_find_var, without copying the partition and without any warm-up.
+//
+// Readers never block the writer: the segment header holds a sequence number which is odd while the writer is
+// changing the partition. A reader retries a lookup which overlapped a change, and bounds checks every offset
+// and size it follows, reading each one once, since it can see the partition half way through a change. A
+// reader waiting for a change to finish gives up if the writer process is gone or after SHARED_MAX_WAIT tries.
+//
+// The segment has a fixed size, so neither the shared partition nor its index grows. The index has room for a variable per
+// SHARED_VAR_SIZE bytes of partition, and adding a variable fails with error 5 once it's full. It holds no pointers, only offsets:
+//      <header> is the shared header, padded to the snapshot alignment
+//      <partition> is the whole partition, padded to the snapshot alignment
+//      <index> is the variable index
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "orb.h"
+
+#ifndef HAVE_MMAP
+#error "shared partitions need POSIX shared memory"
+#endif
+
+//---------- constants ----------
+
+#define SHARED_MAGIC "ORBM"
+#define SHARED_VERSION 4
+
+// average variable element size the index of a segment is sized for
+#define SHARED_VAR_SIZE 16
+
+// number of times a reader waits for the writer to finish a change before giving up
+#define SHARED_MAX_WAIT 1000000
+
+//---------- custom types ----------
+
+// shared segment header
+typedef struct shared_header {
+    char magic[4];                  // SHARED_MAGIC
+    uint16_t version;               // SHARED_VERSION
+    uint8_t sizeWidth;              // size of psize_t in the partition format
+    uint8_t reserved;
+    atomic_uint seq;                // sequence number, odd while the writer is changing the partition
+    int32_t writer;                 // process id of the writer
+    psize_t pSize;                  // partition size
+    psize_t used;                   // offset of the empty area at the end of the partition
+    psize_t iUsed;                  // number of used index slots
+    psize_t slack;                  // bytes the variable elements leave unused
+    psize_t freeList[FREE_CLASSES]; // free lists heads
+} shared_header;
+
+// shared segment attached by a reader
+typedef struct shared_segment {
+    char *base;                     // start of the mapping
+    size_t size;                    // size of the mapping
+    shared_header *h;
+    char *partition;
+    psize_t *index;
+    psize_t pSize;                  // partition size
+    psize_t iSize;                  // number of slots in the index
+} shared_segment;
+
+//---------- layout functions ----------
+
+// function to get the offset of the index in a segment
+static inline size_t shared_index_offset(psize_t size) {
+    return snapshot_align(snapshot_align(sizeof(shared_header)) + size);
+}
+
+// function to get the number of index slots of a segment holding a partition of the specified size
+static inline psize_t shared_index_slots(psize_t size) {
+    return index_slots(size / SHARED_VAR_SIZE);
+}
+
+// function to get the size of a segment holding a partition of the specified size
+static inline size_t shared_size(psize_t size) {
+    return shared_index_offset(size) + shared_index_slots(size) * sizeof(psize_t);
+}
+
+// function to check a segment header, for a partition of the specified size or any size if 0
+static inline bool shared_valid(shared_header *h, size_t mapSize, psize_t size) {
+    return mapSize >= sizeof(shared_header)
+        && memcmp(h->magic, SHARED_MAGIC, 4) == 0
+        && h->version == SHARED_VERSION
+        && h->sizeWidth == sizeof(psize_t)
+        && (size == 0 || h->pSize == size)
+        && h->pSize >= MIN_BLOCK_SIZE
+        && mapSize == shared_size(h->pSize);
+}
+
+//---------- writer functions ----------
+
+// function to copy the partition variables the header keeps, so a restarted writer can take the segment over
+static inline void shared_sync(shared_header *h) {
+    h->used = pEnd - pStart;
+    h->iUsed = iUsed;
+    h->slack = slackBytes;
+    memcpy(h->freeList, freeList, sizeof(freeList));
+}
+
+// function to create a shared segment, or take over an existing one of the same size, as the current partition
+// returns 6 if the segment can't be opened or another live process writes to it
+static inline uint8_t shared_create(char *name, psize_t size) {
+    size_t total = shared_size(size);
+    struct stat st;
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        printf("Error: could not open shared partition '%s'\n", name);
+        return 6;
+    }
+    bool existing = fstat(fd, &st) == 0 && (size_t)st.st_size == total;
+    if (!existing && ftruncate(fd, total) != 0) {
+        printf("Error: could not size shared partition '%s'\n", name);
+        close(fd);
+        return 6;
+    }
+    char *base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("Error: could not map shared partition '%s'\n", name);
+        return 6;
+    }
+    shared_header *h = (shared_header *)base;
+
+    // two writers changing the segment at once would corrupt it, so only take it over from a writer which is gone
+    if (existing && shared_valid(h, total, size) && h->writer > 0 && h->writer != getpid()
+        && !(kill(h->writer, 0) != 0 && errno == ESRCH)) {
+        printf("Error: shared partition '%s' is in use by process %d\n", name, (int)h->writer);
+        munmap(base, total);
+        return 6;
+    }
+
+    // use the segment as the current partition
+    free_partition();
+    pMap = base;
+    pMapSize = total;
+    pShared = true;
+    pSize = size;
+    pStart = base + snapshot_align(sizeof(shared_header));
+    vIndex = (psize_t *)(base + shared_index_offset(size));
+    iSize = shared_index_slots(size);
+
+    // keep a consistent existing partition, otherwise start an empty one
+    if (existing && shared_valid(h, total, size) && (atomic_load(&h->seq) & 1) == 0
+        && (size_t)h->used + ELEMENT_HEADER_SIZE <= size && h->iUsed < iSize && h->slack <= h->used) {
+        pEnd = pStart + h->used;
+        iUsed = h->iUsed;
+        slackBytes = h->slack;
+        memcpy(freeList, h->freeList, sizeof(freeList));
+    } else {
+        atomic_store(&h->seq, 1);
+        memcpy(h->magic, SHARED_MAGIC, 4);
+        h->version = SHARED_VERSION;
+        h->sizeWidth = sizeof(psize_t);
+        h->pSize = size;
+        pEnd = init_empty_area(pStart, pSize);
+        clear_free_lists();
+        slackBytes = 0;
+        memset(vIndex, 0, iSize * sizeof(psize_t));
+        iUsed = 0;
+        shared_sync(h);
+        atomic_store(&h->seq, 2);
+    }
+    h->writer = getpid();
+    return 0;
+}
+
+// function to start changing the shared partition
+static inline void shared_begin_write(shared_header *h) {
+    atomic_fetch_add(&h->seq, 1);
+    atomic_thread_fence(memory_order_release);
+}
+
+// function to finish changing the shared partition
+static inline void shared_end_write(shared_header *h) {
+    shared_sync(h);
+    atomic_thread_fence(memory_order_release);
+    atomic_fetch_add(&h->seq, 1);
+}
+
+// function to add a variable loaded into a variable buffer to the shared partition, returns the add_var error code
+static inline uint8_t shared_add_var(char *v) {
+    shared_header *h = (shared_header *)pMap;
+    shared_begin_write(h);
+    uint8_t err = add_var(v);
+    shared_end_write(h);
+    return err;
+}
+
+// function to set the value of a variable in the shared partition, adding it if it doesn't exist, returns the update_var error code
+static inline uint8_t shared_update_var(char type, char *name, uint8_t size, char *value) {
+    shared_header *h = (shared_header *)pMap;
+    shared_begin_write(h);
+    uint8_t err = update_var(type, name, size, value);
+    shared_end_write(h);
+    return err;
+}
+
+// function to delete a variable from the shared partition
+static inline bool shared_delete_var(char *name) {
+    shared_header *h = (shared_header *)pMap;
+    shared_begin_write(h);
+    bool found = delete_var(name);
+    shared_end_write(h);
+    return found;
+}
+
+// function to remove a shared segment name, the processes attached to it keep their mappings
+static inline void shared_unlink(char *name) {
+    shm_unlink(name);
+}
+
+//---------- reader functions ----------
+
+// function to attach to a shared segment for reading
+static inline uint8_t shared_attach(shared_segment *seg, char *name) {
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        printf("Error: could not open shared partition '%s'\n", name);
+        return 6;
+    }
+    seg->base = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        seg->size = st.st_size;
+        seg->base = mmap(NULL, seg->size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (seg->base == NULL || seg->base == MAP_FAILED) {
+        printf("Error: could not map shared partition '%s'\n", name);
+        return 6;
+    }
+    seg->h = (shared_header *)seg->base;
+    if (!shared_valid(seg->h, seg->size, 0)) {
+        printf("Error: invalid shared partition '%s'\n", name);
+        munmap(seg->base, seg->size);
+        return 7;
+    }
+    // the sizes never change once the segment is created
+    seg->pSize = seg->h->pSize;
+    seg->iSize = shared_index_slots(seg->pSize);
+    seg->partition = seg->base + snapshot_align(sizeof(shared_header));
+    seg->index = (psize_t *)(seg->base + shared_index_offset(seg->pSize));
+    return 0;
+}
+
+// function to detach from a shared segment
+static inline void shared_detach(shared_segment *seg) {
+    munmap(seg->base, seg->size);
+    seg->base = NULL;
+}
+
+// function to look a variable up in a segment and copy it into a variable buffer of the specified size, the result is only
+// meaningful if the sequence number didn't change meanwhile
+static inline bool shared_lookup(shared_segment *seg, char *name, uint8_t size, char *vBuf, size_t vBufSize) {
+    psize_t i = name_hash(name, size) & (seg->iSize - 1);
+    // probe at most the whole index, a torn read can't loop forever
+    for (psize_t probes = 0; probes < seg->iSize; probes++) {
+        psize_t slot = ((volatile psize_t *)seg->index)[i];
+        if (slot == INDEX_EMPTY) {
+            return false;
+        }
+        if (slot != INDEX_DELETED && (size_t)slot - 1 <= (size_t)seg->pSize - MIN_VAR_ELEMENT_SIZE) {
+            volatile char *v = seg->partition + slot - 1 + ELEMENT_HEADER_SIZE;
+            size_t room = seg->pSize - (slot - 1 + ELEMENT_HEADER_SIZE);
+            // read the name size and the value size once, the writer may change them at any time
+            uint8_t nameSize = v[1];
+            if (nameSize == size && (size_t)size + 3 <= room && memcmp((char *)v + 2, name, size) == 0) {
+                size_t varSize = (size_t)nameSize + (uint8_t)v[2 + nameSize] + 3;
+                if (varSize > room || varSize > vBufSize) {
+                    return false;
+                }
+                memcpy(vBuf, (char *)v, varSize);
+                return true;
+            }
+        }
+        i = (i + 1) & (seg->iSize - 1);
+    }
+    return false;
+}
+
+// function to wait while the writer is changing the partition, returns the even sequence number it left or 1 if it's
+// gone or doesn't finish
+static inline unsigned int shared_wait(shared_segment *seg) {
+    for (long wait = 0; wait < SHARED_MAX_WAIT; wait++) {
+        unsigned int seq = atomic_load(&seg->h->seq);
+        if ((seq & 1) == 0) {
+            return seq;
+        }
+        // let the writer run, and check it's still alive from time to time
+        sched_yield();
+        if (wait % 1024 == 1023 && kill(seg->h->writer, 0) != 0 && errno == ESRCH) {
+            return 1;
+        }
+    }
+    return 1;
+}
+
+// function to find a variable in a shared segment and copy it into a variable buffer of the specified size
+// returns false if not found, if it doesn't fit the buffer, or if the writer died or got stuck in the middle of a change
+static inline bool shared_find_var(shared_segment *seg, char *name, char *vBuf, size_t vBufSize) {
+    uint8_t size = strlen(name);
+    for (;;) {
+        unsigned int seq = shared_wait(seg);
+        if (seq & 1) {
+            return false;
+        }
+        bool found = shared_lookup(seg, name, size, vBuf, vBufSize);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load(&seg->h->seq) == seq) {
+            return found;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,192 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "orb.h"
+
+// number of variables in the snapshot
+#define SNAPSHOT_VARS 400
+
+// partition size of the snapshot
+#define SNAPSHOT_PARTITION_SIZE 8000
+
+// contents of the saved snapshot file
+static char *image;
+static size_t imageSize;
+
+// number of failed checks
+static int failures;
+
+// function to report a failed check
+static void fail(char *what) {
+    printf("Error: %s\n", what);
+    failures++;
+}
+
+// function to check the variables left after deleting every third one, and the slack, returns true if they're all there
+static bool check_vars(psize_t slack) {
+    char name[16];
+    for (int i = 0; i < SNAPSHOT_VARS; i++) {
+        sprintf(name, "s%d", i);
+        char *v = find_var(name);
+        if (i % 3 == 0 ? v != NULL : v == NULL || get_var_int(v) != i) {
+            return false;
+        }
+    }
+    return get_slack() == slack;
+}
+
+// function to read a whole file into memory, returns NULL if it can't
+static char *read_file(char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    char *data = NULL;
+    if (f == NULL) {
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) == 0 && (long)(*size = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0 && (data = malloc(*size)) != NULL) {
+        if (fread(data, *size, 1, f) != 1) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+// function to write a copy of the snapshot with a byte changed at the specified offset, or cut to the specified size
+static void write_copy(char *path, size_t offset, char value, size_t size) {
+    FILE *f = fopen(path, "wb");
+    char saved = image[offset];
+    image[offset] = value;
+    if (f == NULL || fwrite(image, size, 1, f) != 1) {
+        fail("could not write a snapshot copy");
+    }
+    image[offset] = saved;
+    if (f != NULL) {
+        fclose(f);
+    }
+}
+
+// function to load a copy of the snapshot with a byte changed, and check the load returns the expected error
+// a rejected snapshot must leave the current partition alone
+static void check_copy(char *path, char *what, size_t offset, char value, size_t size, bool verify, uint8_t expected, psize_t slack) {
+    write_copy(path, offset, value, size);
+    uint8_t err = load_partition(path, verify);
+    printf("%s%s: error %d\n", what, verify ? ", verified" : "", err);
+    if (err != expected) {
+        fail("unexpected load result");
+    }
+    if (!check_vars(slack)) {
+        fail("variables lost after loading");
+    }
+}
+
+// main program
+// save a partition to a snapshot, load it back, then load damaged copies of it, returns 1 if any check failed
+int main(int argc, char *argv[]) {
+    char *path = argc > 1 ? argv[1] : "snapshot.bin";
+    char name[16];
+
+    // fill a partition and delete every third variable, so the free lists and the index have deleted entries
+    patch[6] = SNAPSHOT_PARTITION_SIZE % 256;
+    patch[7] = SNAPSHOT_PARTITION_SIZE / 256;
+    alloc_partition();
+    init_partition();
+    for (int i = 0; i < SNAPSHOT_VARS; i++) {
+        sprintf(name, "s%d", i);
+        load_int_var(vBuf1, name, i);
+        add_var(vBuf1);
+    }
+    for (int i = 0; i < SNAPSHOT_VARS; i += 3) {
+        sprintf(name, "s%d", i);
+        delete_var(name);
+    }
+    psize_t slack = get_slack();
+    psize_t freeBytes, freeBlocks, largest;
+    get_fragmentation(&freeBytes, &freeBlocks, &largest);
+
+    // save it and load it back, with and without verifying the checksum
+    if (save_partition(path) != 0) {
+        fail("could not save the snapshot");
+        return 1;
+    }
+    free_partition();
+    alloc_partition();
+    init_partition();
+    for (int verify = 1; verify >= 0; verify--) {
+        if (load_partition(path, verify) != 0 || !check_vars(slack)) {
+            fail("snapshot didn't load back");
+        }
+        psize_t loadedBytes, loadedBlocks, loadedLargest;
+        get_fragmentation(&loadedBytes, &loadedBlocks, &loadedLargest);
+        if (loadedBytes != freeBytes || loadedBlocks != freeBlocks || loadedLargest != largest) {
+            fail("free space changed in the snapshot");
+        }
+    }
+    printf("round trip: %d variables, %lu free bytes in %lu blocks\n", SNAPSHOT_VARS - (SNAPSHOT_VARS + 2) / 3, (unsigned long)freeBytes, (unsigned long)freeBlocks);
+
+    // a loaded partition can be changed, and deleting the changes brings it back to the snapshot contents
+    load_int_var(vBuf1, "extra", 1);
+    if (add_var(vBuf1) != 0 || !delete_var("extra") || !check_vars(slack)) {
+        fail("loaded partition can't be changed");
+    }
+
+    // the index of a loaded partition is rebuilt in the mapping as variables come and go, and copied to the heap when it shrinks
+    psize_t loadedSlots = iSize;
+    for (int i = 0; i < SNAPSHOT_VARS * 20; i++) {
+        sprintf(name, "g%d", i);
+        load_int_var(vBuf1, name, i);
+        if (add_var(vBuf1) != 0 || !delete_var(name)) {
+            fail("could not change the loaded partition");
+            break;
+        }
+        if (i == SNAPSHOT_VARS * 2 - 1) {
+            if (!check_vars(slack)) {
+                fail("rebuilding the loaded index lost variables");
+            }
+            for (int k = 1; k < SNAPSHOT_VARS; k++) {
+                sprintf(name, "s%d", k);
+                delete_var(name);
+            }
+        }
+    }
+    if (iSize >= loadedSlots || pMap != NULL) {
+        fail("loaded index didn't shrink");
+    }
+    printf("index: %lu slots loaded, %lu after deleting the variables\n", (unsigned long)loadedSlots, (unsigned long)iSize);
+    if (load_partition(path, true) != 0 || !check_vars(slack)) {
+        fail("snapshot didn't load back after the index shrank");
+    }
+
+    // load damaged copies, the partition loaded above must survive each rejected one
+    image = read_file(path, &imageSize);
+    if (image == NULL) {
+        fail("could not read the snapshot");
+        return 1;
+    }
+    snapshot_header *h = (snapshot_header *)image;
+    size_t partitionOffset = snapshot_align(sizeof(snapshot_header));
+    char *copy = "snapshot.tmp";
+    check_copy(copy, "changed partition byte", partitionOffset + h->pSize / 2, ~image[partitionOffset + h->pSize / 2], imageSize, true, 7, slack);
+    check_copy(copy, "changed used slot count", offsetof(snapshot_header, iUsed), image[offsetof(snapshot_header, iUsed)] + 1, imageSize, true, 7, slack);
+    check_copy(copy, "changed checksum", offsetof(snapshot_header, checksum), ~image[offsetof(snapshot_header, checksum)], imageSize, true, 7, slack);
+    // the last byte of the used size is its top byte on little endian machines, and moves the empty area on the others
+    check_copy(copy, "used size past the partition", offsetof(snapshot_header, used) + sizeof(psize_t) - 1, 0x7f, imageSize, false, 7, slack);
+    check_copy(copy, "wrong index size", offsetof(snapshot_header, iSize), image[offsetof(snapshot_header, iSize)] ^ 1, imageSize, false, 7, slack);
+    check_copy(copy, "wrong magic", 0, 'X', imageSize, false, 7, slack);
+    check_copy(copy, "wrong version", offsetof(snapshot_header, version), image[offsetof(snapshot_header, version)] + 1, imageSize, false, 7, slack);
+    check_copy(copy, "truncated file", 0, image[0], imageSize / 2, false, 7, slack);
+    if (load_partition("missing.bin", false) != 6 || !check_vars(slack)) {
+        fail("missing snapshot not reported");
+    }
+    remove(copy);
+    remove(path);
+    free(image);
+    free_partition();
+
+    printf("%d failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,161 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "token.h"
+#include "postfix.h"
+#include "bytecode.h"
+#include "parser.h"
+
+// define the default number of threads and of rounds each thread runs
+#define DEF_THREADS 8
+#define DEF_ROUNDS 20000
+
+// define the expressions of parser.c, including the ones which fail to compile
+char *exprs[] = {
+	"234",
+	"-49",
+	"234.567",
+	"2+3",
+	"2^3",
+	"2+3*4",
+	"2+3*4^5",
+	"(13 + 2) / 3",
+	"\"abc\"",
+	"'abd\\\"asra'",
+	"int(13 / 4)",
+	"int(13 / -(2+2)) + 1",
+	"int(13 / 4) + 1.0",
+	"2-f(3)-7",
+	"2*f(3)/7",
+	"f(2)^2^f(1)-1",
+	"f(1,2)-3",
+	"f(g(1)-2)*3",
+	"-f(2)-3",
+	"2^-3*4",
+	"2*-3+4",
+	"1-2-3",
+	"2^3^2",
+	"$a[1,2]-f(3)*2",
+	"$a[f(1)-2]*3",
+	"2 + $a[17, int(3/-7)]",
+	"2+",
+	"f(1,,2)",
+	"(2+3",
+	"$a>=2"};
+
+#define EXPR_COUNT ((int)(sizeof(exprs) / sizeof(char *)))
+
+// single threaded results each thread compares its own with
+int refErrors[EXPR_COUNT];
+program refPrograms[EXPR_COUNT];
+
+// number of rounds each thread runs
+int rounds = DEF_ROUNDS;
+
+// compile an expression with one of the two compilers, into an arena or onto the heap
+int compileWith(int pratt, char *expr, arena *pool, program *prog) {
+	lexContext ctx;
+	initContext(&ctx, expr);
+	ctx.pool = pool;
+	return pratt ? parseExpr(&ctx, prog) : compileExpr(&ctx, prog);
+}
+
+// return 1 if a result differs from the single threaded one
+int differs(int i, int error, program *prog) {
+	if (error != refErrors[i]) {
+		return 1;
+	}
+	if (error != ERROR_NONE) {
+		return 0;
+	}
+	return prog->size != refPrograms[i].size || prog->depth != refPrograms[i].depth || memcmp(prog->code, refPrograms[i].code, prog->size) != 0;
+}
+
+// thread body, compile every expression in each round, alternating the compilers and the memory they use
+// returns the number of results which differ from the single threaded ones
+void *compileThread(void *arg) {
+	long mismatches = 0;
+	int round, i, pratt, error;
+	program prog;
+
+	// each thread has its own arena
+	arena pool;
+
+	(void)arg;
+	initArena(&pool);
+	for (round = 0; round < rounds; round++) {
+		for (i = 0; i < EXPR_COUNT; i++) {
+			pratt = (round + i) & 1;
+			error = compileWith(pratt, exprs[i], round & 2 ? &pool : NULL, &prog);
+			mismatches += differs(i, error, &prog);
+			if (error == ERROR_NONE) {
+				freeProgram(&prog);
+			}
+		}
+		arenaReset(&pool);
+	}
+	freeArena(&pool);
+	return (void *)mismatches;
+}
+
+// main program
+// compile the expressions on a single thread, then on several threads at once
+// print the number of results which differ from the single threaded ones, and return 1 if there are any
+int main(int argc, char *argv[]) {
+	int threads = argc > 1 ? atoi(argv[1]) : DEF_THREADS;
+	long mismatches = 0;
+	void *result;
+	int i;
+
+	// define the threads
+	pthread_t *ids;
+
+	if (argc > 2) {
+		rounds = atoi(argv[2]);
+	}
+	if (threads < 1 || rounds < 1) {
+		printf("Usage: stress [threads] [rounds]\n");
+		return 1;
+	}
+
+	// compile the reference programs, both compilers must agree for the comparison to make sense
+	for (i = 0; i < EXPR_COUNT; i++) {
+		program check;
+		int error = compileWith(1, exprs[i], NULL, &check);
+		refErrors[i] = compileWith(0, exprs[i], NULL, &refPrograms[i]);
+		if (differs(i, error, &check)) {
+			printf("%s: the compilers disagree\n", exprs[i]);
+			return 1;
+		}
+		if (error == ERROR_NONE) {
+			freeProgram(&check);
+		}
+	}
+
+	// compile them again on all the threads at once
+	ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+	if (ids == NULL) {
+		return 1;
+	}
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&ids[i], NULL, compileThread, NULL) != 0) {
+			printf("Error: could not start thread %d\n", i);
+			return 1;
+		}
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(ids[i], &result);
+		mismatches += (long)result;
+	}
+	free(ids);
+
+	for (i = 0; i < EXPR_COUNT; i++) {
+		if (refErrors[i] == ERROR_NONE) {
+			freeProgram(&refPrograms[i]);
+		}
+	}
+	printf("%d threads, %ld compilations, %ld mismatches\n", threads, (long)threads * rounds * EXPR_COUNT, mismatches);
+	return mismatches != 0;
+}
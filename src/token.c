@@ -33,36 +33,39 @@ int main() {
 		"2 + $a[17, int(3/-7)]"};
 
 	// local variables
-	int i;
+	int i, j;
 	int error;
+	char token[MAX_TOKEN_LENGTH];
 
-	// create a linked list for tokens
-	tokenStack *tokens = NULL;
+	// create a lexer context
+	lexContext ctx;
+
+	// create a vector for tokens
+	tokenVector tokens;
 
 	for (i = 0; i < sizeof(exprs) / sizeof(char *); i++) {
-		pExpr  = 0;
-		pType  = TOKEN_END;
-		pLevel = 0;
-		bLevel = 0;
+		initContext(&ctx, exprs[i]);
+		initVector(&tokens);
 		printf("%s = ", exprs[i]);
-		error = tokenize(exprs[i], &tokens);
+		error = tokenize(&ctx, &tokens);
 		if (error != ERROR_NONE) {
-			printf("Error: %s at %d\n", errorMessages[error], pExpr);
-			for (int j = 0; j < pExpr; j++) {
+			printf("Error: %s at %d\n", errorMessages[error], ctx.pExpr);
+			for (j = 0; j < ctx.pExpr; j++) {
 				printf(" ");
 			}
 			printf("^\n");
 		} else {
 			printf("[");
-			while (tokens != NULL) {
-				printf("%s", tokens->token);
-				tokens = tokens->next;
-				if (tokens != NULL) {
+			for (j = 0; j < tokens.count; j++) {
+				spanText(exprs[i], &tokens.items[j], token);
+				printf("%s", token);
+				if (j < tokens.count - 1) {
 					printf(" ");
 				}
 			}
 			printf("]\n");
 		}
+		freeVector(&tokens);
 	}
 	return 0;
 }
\ No newline at end of file
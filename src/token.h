@@ -1,6 +1,10 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <limits.h>
+#include <locale.h>
+#include "arena.h"
+
 // define the maximum length of the token
 #define MAX_TOKEN_LENGTH 512
 
@@ -50,7 +54,9 @@ enum errorCodes {
 	ERROR_OUT_OF_MEMORY,
 	ERROR_STACK_UNDERFLOW,
 	ERROR_UNKNOWN_OPERATOR,
-	ERROR_SYNTAX
+	ERROR_SYNTAX,
+	ERROR_STACK_OVERFLOW,
+	ERROR_TYPE_MISMATCH
 };
 
 // enumerate the error messages
@@ -66,7 +72,31 @@ char *errorMessages[] = {"No error",
 						 "Out of memory",
 						 "Stack underflow",
 						 "Unknown operator",
-						 "Syntax error"};
+						 "Syntax error",
+						 "Stack overflow",
+						 "Type mismatch"};
+
+// enumerate the operators, resolved once by the lexer
+enum operators {
+	OPR_NONE,
+	OPR_UNKNOWN,
+	OPR_NEG,
+	OPR_POS,
+	OPR_NOT,
+	OPR_POW,
+	OPR_MUL,
+	OPR_DIV,
+	OPR_MOD,
+	OPR_ADD,
+	OPR_SUB,
+	OPR_GT,
+	OPR_GE,
+	OPR_LT,
+	OPR_LE,
+	OPR_EQ,
+	OPR_NE,
+	OPR_ASSIGN
+};
 
 // return the error message for the given error code
 char *getErrorMessage(int error) {
@@ -94,15 +124,161 @@ char l_bracket[] = "[";
 char r_bracket[] = "]";
 char comma[]	 = ",";
 
-// integer to track the current position in the input string
-int pExpr = 0;
+// lexer state for a single expression
+// each thread tokenizing or compiling an expression uses its own context
+typedef struct lexContext {
+	char *expr;	 // expression being scanned
+	int pExpr;	 // current position in the input string
+	int pType;	 // previous token type
+	int pLevel;	 // parentheses level
+	int bLevel;	 // brackets level
+	arena *pool; // arena for the memory used while compiling, or NULL for the heap
+} lexContext;
+
+// token view into the source expression, it doesn't own any memory
+typedef struct tokenSpan {
+	int type;	// token type
+	int offset; // offset of the token in the expression
+	int length; // length of the token in the expression
+	int op;		 // unary and operator tokens: operator code
+	int isFloat; // number tokens: true if the literal has a decimal point
+	// number tokens: value decoded at lex time
+	union {
+		long integer;
+		double real;
+	} num;
+} tokenSpan;
+
+// powers of ten which are exactly representable as doubles
+static const double pow10Table[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+									1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// function to decode the text of a number literal into a span
+// literals with up to 15 significant digits and 22 decimals are converted exactly with a single division
+// longer ones go through strtod, with the decimal point of the current locale
+void decodeNumber(char *text, int length, tokenSpan *span) {
+	char buf[MAX_TOKEN_LENGTH + 1];
+	double mantissa = 0;
+	long integer	= 0;
+	int digits		= 0;
+	int decimals	= 0;
+	int overflow	= 0;
+	int i;
+
+	span->isFloat = 0;
+	for (i = 0; i < length; i++) {
+		if (text[i] == '.') {
+			span->isFloat = 1;
+			continue;
+		}
+		if (mantissa != 0 || text[i] != '0') {
+			digits++;
+		}
+		mantissa = mantissa * 10 + (text[i] - '0');
+		if (span->isFloat) {
+			decimals++;
+		} else if (integer > (LONG_MAX - (text[i] - '0')) / 10) {
+			overflow = 1;
+		} else {
+			integer = integer * 10 + (text[i] - '0');
+		}
+	}
 
-// integer to track the previous token type
-int pType = TOKEN_END;
+	if (!span->isFloat && !overflow) {
+		span->num.integer = integer;
+		return;
+	}
+	span->isFloat = 1;
+	if (digits <= 15 && decimals <= 22) {
+		span->num.real = mantissa / pow10Table[decimals];
+		return;
+	}
+	for (i = 0; i < length; i++) {
+		buf[i] = text[i] == '.' ? *localeconv()->decimal_point : text[i];
+	}
+	buf[length]	   = '\0';
+	span->num.real = strtod(buf, NULL);
+}
+
+// return the value of a number span as a double
+double spanNumber(tokenSpan *span) {
+	return span->isFloat ? span->num.real : (double)span->num.integer;
+}
 
-// integers to track parentheses and brackets level
-int pLevel = 0;
-int bLevel = 0;
+// growable array of token spans, appending is amortised O(1)
+typedef struct tokenVector {
+	tokenSpan *items;
+	int count;
+	int capacity;
+	arena *pool; // arena the items come from, or NULL for the heap
+} tokenVector;
+
+// initialize an empty token vector
+void initVector(tokenVector *vector) {
+	vector->items	 = NULL;
+	vector->count	 = 0;
+	vector->capacity = 0;
+	vector->pool	 = NULL;
+}
+
+// append a span at the end of the vector, doubling its capacity when full
+int appendSpan(tokenVector *vector, tokenSpan *span) {
+	tokenSpan *items;
+	int capacity;
+	if (vector->count == vector->capacity) {
+		capacity = vector->capacity ? vector->capacity * 2 : 16;
+		if (vector->pool != NULL) {
+			items = (tokenSpan *)arenaRealloc(vector->pool, vector->items, vector->capacity * sizeof(tokenSpan), capacity * sizeof(tokenSpan));
+		} else {
+			items = (tokenSpan *)realloc(vector->items, capacity * sizeof(tokenSpan));
+		}
+		if (items == NULL) {
+			return ERROR_OUT_OF_MEMORY;
+		}
+		vector->items	 = items;
+		vector->capacity = capacity;
+	}
+	vector->items[vector->count++] = *span;
+	return ERROR_NONE;
+}
+
+// remove the span at the end of the vector
+int popSpan(tokenVector *vector, tokenSpan *span) {
+	if (vector->count == 0) {
+		return ERROR_STACK_UNDERFLOW;
+	}
+	*span = vector->items[--vector->count];
+	return ERROR_NONE;
+}
+
+// return the span at the end of the vector, or NULL if it is empty
+tokenSpan *topSpan(tokenVector *vector) {
+	if (vector->count == 0) {
+		return NULL;
+	}
+	return &vector->items[vector->count - 1];
+}
+
+// free the memory of the vector
+// vectors allocated from an arena are released with the arena
+void freeVector(tokenVector *vector) {
+	arena *pool = vector->pool;
+	if (pool == NULL) {
+		free(vector->items);
+	}
+	initVector(vector);
+	vector->pool = pool;
+}
+
+// initialize a lexer context for the given expression
+void initContext(lexContext *ctx, char *expr) {
+	ctx->expr	= expr;
+	ctx->pExpr	= 0;
+	ctx->pType	= TOKEN_END;
+	ctx->pLevel = 0;
+	ctx->bLevel = 0;
+	ctx->pool	= NULL;
+}
 
 // stack to contain the tokens
 typedef struct tokenStack {
@@ -116,16 +292,12 @@ typedef struct tokenStack {
 int pushToken(tokenStack **stack, char *token, int type) {
 	tokenStack *newNode;
 	// allocate memory for the new node
-	newNode = (tokenStack *)malloc(sizeof(tokenStack));
+	// the token text is stored right after the node, so both come from a single allocation
+	newNode = (tokenStack *)malloc(sizeof(tokenStack) + strlen(token) + 1);
 	if (newNode == NULL) {
 		return ERROR_OUT_OF_MEMORY;
 	}
-	// allocate memory for the token
-	newNode->token = (char *)malloc(strlen(token) + 1);
-	if (newNode->token == NULL) {
-		free(newNode);
-		return ERROR_OUT_OF_MEMORY;
-	}
+	newNode->token = (char *)(newNode + 1);
 	// copy the token to the new node
 	strcpy(newNode->token, token);
 	newNode->type = type;
@@ -152,7 +324,6 @@ int popToken(tokenStack **stack, char *token, int* type) {
 	*type = (*stack)->type;
 	// pop the top node off the stack
 	nextNode = (*stack)->next;
-	free((*stack)->token);
 	free(*stack);
 	*stack = nextNode;
 	// return success
@@ -176,16 +347,12 @@ int appendToken(tokenStack **stack, char *token, int type) {
 	tokenStack *newNode;
 	tokenStack *lastNode;
 	// allocate memory for the new node
-	newNode = (tokenStack *)malloc(sizeof(tokenStack));
+	// the token text is stored right after the node, so both come from a single allocation
+	newNode = (tokenStack *)malloc(sizeof(tokenStack) + strlen(token) + 1);
 	if (newNode == NULL) {
 		return ERROR_OUT_OF_MEMORY;
 	}
-	// allocate memory for the token
-	newNode->token = (char *)malloc(strlen(token) + 1);
-	if (newNode->token == NULL) {
-		free(newNode);
-		return ERROR_OUT_OF_MEMORY;
-	}
+	newNode->token = (char *)(newNode + 1);
 	// copy the token to the new node
 	strcpy(newNode->token, token);
 	newNode->type = type;
@@ -211,7 +378,6 @@ void freeStack(tokenStack *stack) {
 	tokenStack *nextNode;
 	while (stack != NULL) {
 		nextNode = stack->next;
-		free(stack->token);
 		free(stack);
 		stack = nextNode;
 	}
@@ -220,8 +386,8 @@ void freeStack(tokenStack *stack) {
 // function to check if the previous token was an operator, left parenthesis, left bracket, comma or the beginning of the expression
 // This is used for:
 // - unary operators
-int pTokenValid1() {
-	return pType == TOKEN_OPERATOR || pType == TOKEN_L_PAREN || pType == TOKEN_L_BRACKET || pType == TOKEN_COMMA || pType == TOKEN_END;
+int pTokenValid1(lexContext *ctx) {
+	return ctx->pType == TOKEN_OPERATOR || ctx->pType == TOKEN_L_PAREN || ctx->pType == TOKEN_L_BRACKET || ctx->pType == TOKEN_COMMA || ctx->pType == TOKEN_END;
 }
 
 // function to check if the previous token was an unary, an operator, left parenthesis, left bracket, comma or the beginning of the expression
@@ -230,28 +396,28 @@ int pTokenValid1() {
 // - strings
 // - variables
 // - functions
-int pTokenValid2() {
-	return pType == TOKEN_UNARY || pType == TOKEN_OPERATOR || pType == TOKEN_L_PAREN || pType == TOKEN_L_BRACKET || pType == TOKEN_COMMA || pType == TOKEN_END;
+int pTokenValid2(lexContext *ctx) {
+	return ctx->pType == TOKEN_UNARY || ctx->pType == TOKEN_OPERATOR || ctx->pType == TOKEN_L_PAREN || ctx->pType == TOKEN_L_BRACKET || ctx->pType == TOKEN_COMMA || ctx->pType == TOKEN_END;
 }
 
 // function to check if the previous token was an unary, an operator or a function
 // This is used at the end of the expression
-int pTokenValid3() {
-	return pType == TOKEN_UNARY || pType == TOKEN_OPERATOR || pType == TOKEN_FUNCTION;
+int pTokenValid3(lexContext *ctx) {
+	return ctx->pType == TOKEN_UNARY || ctx->pType == TOKEN_OPERATOR || ctx->pType == TOKEN_FUNCTION;
 }
 
 // function to check if the previous token was a number, a string, a variable, a function, a right parenthesis or a right bracket
 // This is used for:
 // - commas
-int pTokenValid4() {
-	return pType == TOKEN_NUMBER || pType == TOKEN_STRING || pType == TOKEN_VARIABLE || pType == TOKEN_FUNCTION || pType == TOKEN_R_PAREN || pType == TOKEN_R_BRACKET;
+int pTokenValid4(lexContext *ctx) {
+	return ctx->pType == TOKEN_NUMBER || ctx->pType == TOKEN_STRING || ctx->pType == TOKEN_VARIABLE || ctx->pType == TOKEN_FUNCTION || ctx->pType == TOKEN_R_PAREN || ctx->pType == TOKEN_R_BRACKET;
 }
 
 // function to check if the previous token was an unary, an operator, a function, a left parenthesis, left bracket, comma or the beginning of the expression
 // This is used for:
 // - left parenthesis
-int pTokenValid5() {
-	return pType == TOKEN_UNARY || pType == TOKEN_OPERATOR || pType == TOKEN_FUNCTION || pType == TOKEN_L_PAREN || pType == TOKEN_L_BRACKET || pType == TOKEN_COMMA || pType == TOKEN_END;
+int pTokenValid5(lexContext *ctx) {
+	return ctx->pType == TOKEN_UNARY || ctx->pType == TOKEN_OPERATOR || ctx->pType == TOKEN_FUNCTION || ctx->pType == TOKEN_L_PAREN || ctx->pType == TOKEN_L_BRACKET || ctx->pType == TOKEN_COMMA || ctx->pType == TOKEN_END;
 }
 
 // function to check if the previous token was a number, a string, a variable, a right parenthesis or a right bracket
@@ -259,203 +425,337 @@ int pTokenValid5() {
 // - operators
 // - right parenthesis
 // - right bracket
-int pTokenValid6() {
-	return pType == TOKEN_NUMBER || pType == TOKEN_STRING || pType == TOKEN_VARIABLE || pType == TOKEN_R_PAREN || pType == TOKEN_R_BRACKET;
+int pTokenValid6(lexContext *ctx) {
+	return ctx->pType == TOKEN_NUMBER || ctx->pType == TOKEN_STRING || ctx->pType == TOKEN_VARIABLE || ctx->pType == TOKEN_R_PAREN || ctx->pType == TOKEN_R_BRACKET;
 }
 
-// function to get the next token from the input string
-int nextToken(char *expr, char *token, int *type) {
+// lexer states, selected by the first character of a token
+enum lexStates {
+	LEX_NONE,
+	LEX_NUMBER,
+	LEX_STRING,
+	LEX_DSTRING,
+	LEX_OPERATOR,
+	LEX_VARIABLE,
+	LEX_FUNCTION,
+	LEX_COMMA,
+	LEX_L_PAREN,
+	LEX_R_PAREN,
+	LEX_L_BRACKET,
+	LEX_R_BRACKET
+};
+
+// character class flags, used while scanning the rest of a token
+#define CC_STATE 0x00f
+#define CC_SPACE 0x010
+#define CC_UNARY 0x020
+#define CC_NUM	 0x040
+#define CC_OP	 0x080
+#define CC_VAR	 0x100
+#define CC_FUN	 0x200
+
+// character class table, the low nibble is the starting lexer state and the upper bits are the CC_* flags
+// it mirrors the character sets above, so keep both in sync
+static const unsigned short charClass[256] = {
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x010, 0x010, 0x000, 0x000, 0x010, 0x000, 0x000, // 0x00
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0x10
+	0x010, 0x024, 0x003, 0x004, 0x005, 0x000, 0x000, 0x002, 0x008, 0x009, 0x004, 0x024, 0x007, 0x024, 0x041, 0x004, // 0x20
+	0x141, 0x141, 0x141, 0x141, 0x141, 0x141, 0x141, 0x141, 0x141, 0x141, 0x000, 0x000, 0x004, 0x084, 0x084, 0x000, // 0x30
+	0x000, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, // 0x40
+	0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x106, 0x00a, 0x000, 0x00b, 0x004, 0x100, // 0x50
+	0x000, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, // 0x60
+	0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x306, 0x000, 0x000, 0x000, 0x000, 0x000, // 0x70
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0x80
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0x90
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0xa0
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0xb0
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0xc0
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0xd0
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0xe0
+	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, // 0xf0
+};
+
+// function to resolve the text of a binary operator into its operator code
+int resolveOperator(char *text, int length) {
+	if (length == 1) {
+		switch (text[0]) {
+		case '^':
+			return OPR_POW;
+		case '*':
+			return OPR_MUL;
+		case '/':
+			return OPR_DIV;
+		case '%':
+			return OPR_MOD;
+		case '+':
+			return OPR_ADD;
+		case '-':
+			return OPR_SUB;
+		case '>':
+			return OPR_GT;
+		case '<':
+			return OPR_LT;
+		case '=':
+			return OPR_ASSIGN;
+		}
+	} else if (length == 2 && text[1] == '=') {
+		switch (text[0]) {
+		case '>':
+			return OPR_GE;
+		case '<':
+			return OPR_LE;
+		case '=':
+			return OPR_EQ;
+		case '!':
+			return OPR_NE;
+		}
+	}
+	return OPR_UNKNOWN;
+}
+
+// return the character class of a character
+#define classOf(c) (charClass[(unsigned char)(c)])
+
+// function to get the next token from the input string as a span, without copying its text
+int nextSpan(lexContext *ctx, tokenSpan *span) {
+	char *expr = ctx->expr;
 	int pToken = 0;
 	int dCount = 0;
-	token[0]   = '\0';
-	*type	   = TOKEN_ERROR;
-	char c	   = expr[pExpr];
+	char c	   = expr[ctx->pExpr];
+	span->type = TOKEN_ERROR;
+	span->op   = OPR_NONE;
 
-	while (strchr(spaces, c) != NULL && c != '\0') {
-		c = expr[++pExpr];
+	while (classOf(c) & CC_SPACE) {
+		c = expr[++ctx->pExpr];
 	}
 
+	span->offset = ctx->pExpr;
+	span->length = 0;
+
 	if (c == '\0') {
-		if (pTokenValid3()) {
+		if (pTokenValid3(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		if (pLevel != 0) {
+		if (ctx->pLevel != 0) {
 			return ERROR_UNBALANCED_PAREN;
 		}
-		if (bLevel != 0) {
+		if (ctx->bLevel != 0) {
 			return ERROR_UNBALANCED_BRACKET;
 		}
-		*type = TOKEN_END;
+		span->type = TOKEN_END;
 		return ERROR_NONE;
 	}
 
-	if (strchr(unaries, c) != NULL && c != '\0') {
-		if (pTokenValid1()) {
-			token[pToken++] = c;
-			token[pToken++] = 'u';
-			pExpr++;
-			token[pToken] = '\0';
-			*type		  = TOKEN_UNARY;
-			pType		  = TOKEN_UNARY;
-			return ERROR_NONE;
-		}
+	if ((classOf(c) & CC_UNARY) && pTokenValid1(ctx)) {
+		ctx->pExpr++;
+		span->length = 1;
+		span->type	 = TOKEN_UNARY;
+		span->op	 = c == '-' ? OPR_NEG : c == '+' ? OPR_POS : OPR_NOT;
+		ctx->pType	 = TOKEN_UNARY;
+		return ERROR_NONE;
 	}
 
-	if (strchr(num_chars, c) != NULL) {
-		if (!pTokenValid2()) {
+	switch (classOf(c) & CC_STATE) {
+	case LEX_NUMBER:
+		if (!pTokenValid2(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		c				= expr[++pExpr];
-		while (strchr(num_chars, c) != NULL && pToken < MAX_TOKEN_LENGTH && c != '\0') {
+		// count a leading decimal point too, so ".5.3" is rejected like "1.2.3"
+		dCount = c == '.';
+		pToken++;
+		c = expr[++ctx->pExpr];
+		while ((classOf(c) & CC_NUM) && pToken < MAX_TOKEN_LENGTH) {
 			if (c == '.') {
 				dCount++;
 			}
 			if (dCount > 1) {
 				return ERROR_INVALID_NUMBER;
 			}
-			token[pToken++] = c;
-			c				= expr[++pExpr];
+			pToken++;
+			c = expr[++ctx->pExpr];
 		}
-		*type = TOKEN_NUMBER;
-	} else if (strchr(str_start, c) != NULL) {
-		if (!pTokenValid2()) {
+		span->type = TOKEN_NUMBER;
+		decodeNumber(expr + span->offset, ctx->pExpr - span->offset, span);
+		break;
+	case LEX_STRING:
+		if (!pTokenValid2(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		c				= expr[++pExpr];
-		while (strchr(str_start, c) == NULL && pToken < MAX_TOKEN_LENGTH && c != '\0') {
-			token[pToken++] = c;
-			c				= expr[++pExpr];
+		pToken++;
+		c = expr[++ctx->pExpr];
+		while (c != '\'' && c != '\0' && pToken < MAX_TOKEN_LENGTH) {
+			pToken++;
+			c = expr[++ctx->pExpr];
 		}
 		if (c == '\0' || pToken >= MAX_TOKEN_LENGTH) {
 			return ERROR_UNBALANCED_QUOTE;
 		}
-		token[pToken++] = c;
-		c				= expr[++pExpr];
-		*type			= TOKEN_STRING;
-	} else if (strchr(dtr_start, c) != NULL) {
-		if (!pTokenValid2()) {
+		ctx->pExpr++;
+		span->type = TOKEN_STRING;
+		break;
+	case LEX_DSTRING:
+		if (!pTokenValid2(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		c				= expr[++pExpr];
-		while (strchr(dtr_start, c) == NULL && pToken < MAX_TOKEN_LENGTH && c != '\0') {
+		pToken++;
+		c = expr[++ctx->pExpr];
+		while (c != '"' && c != '\0' && pToken < MAX_TOKEN_LENGTH) {
 			if (c == '\\') {
-				c = expr[++pExpr];
+				c = expr[++ctx->pExpr];
 			}
-			token[pToken++] = c;
-			c				= expr[++pExpr];
+			pToken++;
+			c = expr[++ctx->pExpr];
 		}
 		if (c == '\0' || pToken >= MAX_TOKEN_LENGTH) {
 			return ERROR_UNBALANCED_QUOTE;
 		}
-		token[pToken++] = c;
-		c				= expr[++pExpr];
-		*type			= TOKEN_STRING;
-	} else if (strchr(op_start, c) != NULL) {
-		if (!pTokenValid6()) {
+		ctx->pExpr++;
+		span->type = TOKEN_STRING;
+		break;
+	case LEX_OPERATOR:
+		if (!pTokenValid6(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		c				= expr[++pExpr];
-		while (strchr(op_chars, c) != NULL && pToken < MAX_TOKEN_LENGTH && c != '\0') {
-			token[pToken++] = c;
-			c				= expr[++pExpr];
+		pToken++;
+		c = expr[++ctx->pExpr];
+		while ((classOf(c) & CC_OP) && pToken < MAX_TOKEN_LENGTH) {
+			pToken++;
+			c = expr[++ctx->pExpr];
 		}
-		*type = TOKEN_OPERATOR;
-	} else if (strchr(var_start, c) != NULL) {
-		if (!pTokenValid2()) {
+		span->type = TOKEN_OPERATOR;
+		span->op   = resolveOperator(expr + span->offset, ctx->pExpr - span->offset);
+		break;
+	case LEX_VARIABLE:
+		if (!pTokenValid2(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		c				= expr[++pExpr];
-		while (strchr(var_chars, c) != NULL && pToken < MAX_TOKEN_LENGTH && c != '\0') {
-			token[pToken++] = c;
-			c				= expr[++pExpr];
+		pToken++;
+		c = expr[++ctx->pExpr];
+		while ((classOf(c) & CC_VAR) && pToken < MAX_TOKEN_LENGTH) {
+			pToken++;
+			c = expr[++ctx->pExpr];
 		}
-		*type = TOKEN_VARIABLE;
-	} else if (strchr(fun_start, c) != NULL) {
-		if (!pTokenValid2()) {
+		span->type = TOKEN_VARIABLE;
+		break;
+	case LEX_FUNCTION:
+		if (!pTokenValid2(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		c				= expr[++pExpr];
-		while (strchr(fun_chars, c) != NULL && pToken < MAX_TOKEN_LENGTH && c != '\0') {
-			token[pToken++] = c;
-			c				= expr[++pExpr];
+		pToken++;
+		c = expr[++ctx->pExpr];
+		while ((classOf(c) & CC_FUN) && pToken < MAX_TOKEN_LENGTH) {
+			pToken++;
+			c = expr[++ctx->pExpr];
 		}
-		*type = TOKEN_FUNCTION;
-	} else if (strchr(comma, c) != NULL) {
-		if (!pTokenValid4()) {
+		span->type = TOKEN_FUNCTION;
+		break;
+	case LEX_COMMA:
+		if (!pTokenValid4(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		pExpr++;
-		*type = TOKEN_COMMA;
-	} else if (strchr(l_paren, c) != NULL) {
-		if (!pTokenValid5()) {
+		ctx->pExpr++;
+		span->type = TOKEN_COMMA;
+		break;
+	case LEX_L_PAREN:
+		if (!pTokenValid5(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		pLevel++;
-		pExpr++;
-		*type = TOKEN_L_PAREN;
-	} else if (strchr(r_paren, c) != NULL) {
-		if (!pTokenValid6()) {
+		ctx->pLevel++;
+		ctx->pExpr++;
+		span->type = TOKEN_L_PAREN;
+		break;
+	case LEX_R_PAREN:
+		if (!pTokenValid6(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		pLevel--;
-		if (pLevel < 0) {
+		ctx->pLevel--;
+		if (ctx->pLevel < 0) {
 			return ERROR_UNBALANCED_PAREN;
 		}
-		pExpr++;
-		*type = TOKEN_R_PAREN;
-	} else if (strchr(l_bracket, c) != NULL) {
-		if (!pType == TOKEN_VARIABLE) {
+		ctx->pExpr++;
+		span->type = TOKEN_R_PAREN;
+		break;
+	case LEX_L_BRACKET:
+		if (!ctx->pType == TOKEN_VARIABLE) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		bLevel++;
-		pExpr++;
-		*type = TOKEN_L_BRACKET;
-	} else if (strchr(r_bracket, c) != NULL) {
-		if (!pTokenValid6()) {
+		ctx->bLevel++;
+		ctx->pExpr++;
+		span->type = TOKEN_L_BRACKET;
+		break;
+	case LEX_R_BRACKET:
+		if (!pTokenValid6(ctx)) {
 			return ERROR_INVALID_CHARACTER;
 		}
-		token[pToken++] = c;
-		bLevel--;
-		if (bLevel < 0) {
+		ctx->bLevel--;
+		if (ctx->bLevel < 0) {
 			return ERROR_UNBALANCED_BRACKET;
 		}
-		pExpr++;
-		*type = TOKEN_R_BRACKET;
-	} else {
+		ctx->pExpr++;
+		span->type = TOKEN_R_BRACKET;
+		break;
+	default:
 		return ERROR_INVALID_CHARACTER;
 	}
 
+	span->length = ctx->pExpr - span->offset;
+	return ERROR_NONE;
+}
+
+// function to copy the text of a span into a token buffer
+// unary operators get an 'u' suffix and escapes are removed from double quoted strings
+int spanText(char *expr, tokenSpan *span, char *token) {
+	char *p	   = expr + span->offset;
+	char *end  = p + span->length;
+	int pToken = 0;
+
+	if (span->type == TOKEN_UNARY) {
+		token[pToken++] = *p;
+		token[pToken++] = 'u';
+	} else if (span->type == TOKEN_STRING && *p == '"') {
+		token[pToken++] = *p++;
+		while (p < end - 1) {
+			if (*p == '\\') {
+				p++;
+			}
+			token[pToken++] = *p++;
+		}
+		token[pToken++] = *p;
+	} else {
+		memcpy(token, p, span->length);
+		pToken = span->length;
+	}
 	token[pToken] = '\0';
+	return pToken;
+}
+
+// function to get the next token from the input string
+int nextToken(lexContext *ctx, char *token, int *type) {
+	tokenSpan span;
+	int error = nextSpan(ctx, &span);
+
+	*type = span.type;
+	if (error != ERROR_NONE) {
+		token[0] = '\0';
+		return error;
+	}
+	spanText(ctx->expr, &span, token);
 	return ERROR_NONE;
 }
 
 // function to tokenize an expression
-int tokenize(char *expr, tokenStack **tokens) {
-	int type;
+int tokenize(lexContext *ctx, tokenVector *tokens) {
+	tokenSpan span;
 	int error;
-	char token[MAX_TOKEN_LENGTH];
-	// initialize the stack
-	*tokens = NULL;
 	// tokenize the expression
-	while ((error = nextToken(expr, token, &type)) == ERROR_NONE && type != TOKEN_END) {
-		// append the token to the stack
-		error = appendToken(tokens, token, type);
-
-		pType = type;
-		if (error != ERROR_NONE) {
+	while ((error = nextSpan(ctx, &span)) == ERROR_NONE && span.type != TOKEN_END) {
+		// append the token to the vector
+		if ((error = appendSpan(tokens, &span)) != ERROR_NONE) {
 			return error;
 		}
+		ctx->pType = span.type;
 	}
+	return error;
 }
 
 #endif
\ No newline at end of file
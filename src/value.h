@@ -0,0 +1,139 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stdio.h>
+#include "token.h"
+
+// define the capacity of the value stack
+#define MAX_VALUE_STACK 256
+
+// enumerate the value types, using the same codes as the variable types
+enum valueTypes {
+	VALUE_NULL,
+	VALUE_BOOL,
+	VALUE_CHAR,
+	VALUE_INT,
+	VALUE_FLOAT,
+	VALUE_STRING
+};
+
+// tagged value produced while evaluating an expression
+typedef struct value {
+	int type;
+	union {
+		int boolean;
+		char character;
+		long integer;
+		double real;
+		// strings point to their quoted text, they are only unescaped when formatted
+		struct {
+			char *text;
+			int length;
+		} string;
+	} as;
+} value;
+
+// fixed capacity stack of values
+typedef struct valueStack {
+	value items[MAX_VALUE_STACK];
+	int count;
+} valueStack;
+
+// initialize an empty value stack
+void initValueStack(valueStack *stack) {
+	stack->count = 0;
+}
+
+// push a value onto the stack
+int pushValue(valueStack *stack, value *item) {
+	if (stack->count == MAX_VALUE_STACK) {
+		return ERROR_STACK_OVERFLOW;
+	}
+	stack->items[stack->count++] = *item;
+	return ERROR_NONE;
+}
+
+// pop a value from the stack
+int popValue(valueStack *stack, value *item) {
+	if (stack->count == 0) {
+		return ERROR_STACK_UNDERFLOW;
+	}
+	*item = stack->items[--stack->count];
+	return ERROR_NONE;
+}
+
+// push a float value onto the stack
+int pushFloat(valueStack *stack, double real) {
+	value item;
+	item.type	 = VALUE_FLOAT;
+	item.as.real = real;
+	return pushValue(stack, &item);
+}
+
+// return true if the value can be used as a number
+int isNumeric(value *item) {
+	return item->type == VALUE_BOOL || item->type == VALUE_CHAR || item->type == VALUE_INT || item->type == VALUE_FLOAT;
+}
+
+// return the value as a double
+double valueNumber(value *item) {
+	switch (item->type) {
+	case VALUE_BOOL:
+		return item->as.boolean;
+	case VALUE_CHAR:
+		return item->as.character;
+	case VALUE_INT:
+		return (double)item->as.integer;
+	case VALUE_FLOAT:
+		return item->as.real;
+	default:
+		return 0;
+	}
+}
+
+// build a value from a number, string or variable span
+int spanValue(char *expr, tokenSpan *span, value *item) {
+	switch (span->type) {
+	case TOKEN_NUMBER:
+		if (span->isFloat) {
+			item->type	  = VALUE_FLOAT;
+			item->as.real = span->num.real;
+		} else {
+			item->type		 = VALUE_INT;
+			item->as.integer = span->num.integer;
+		}
+		return ERROR_NONE;
+	case TOKEN_STRING:
+		item->type				= VALUE_STRING;
+		item->as.string.text	= expr + span->offset;
+		item->as.string.length	= span->length;
+		return ERROR_NONE;
+	default:
+		// variables are not bound to the evaluator
+		return ERROR_INVALID_VARIABLE;
+	}
+}
+
+// format a value as text into a token buffer
+int formatValue(value *item, char *token) {
+	tokenSpan span;
+	switch (item->type) {
+	case VALUE_BOOL:
+		return sprintf(token, "%s", item->as.boolean ? "true" : "false");
+	case VALUE_CHAR:
+		return sprintf(token, "%c", item->as.character);
+	case VALUE_INT:
+		return sprintf(token, "%ld", item->as.integer);
+	case VALUE_FLOAT:
+		return sprintf(token, "%f", item->as.real);
+	case VALUE_STRING:
+		span.type	= TOKEN_STRING;
+		span.offset = 0;
+		span.length = item->as.string.length;
+		return spanText(item->as.string.text, &span, token);
+	default:
+		return sprintf(token, "null");
+	}
+}
+
+#endif